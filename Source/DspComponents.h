@@ -1,9 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <math.h>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "../dsp/delay.h"
+#include "PerfInstrumentation.h"
+#include "TraceEvents.h"
 #include "juce_dsp/juce_dsp.h"
 
 #undef DELAY_MOD
@@ -79,8 +86,77 @@ namespace Mixer
     };
 }
 
-using Delay = signalsmith::delay::Delay<float, signalsmith::delay::InterpolatorKaiserSinc4>;
+/**
+ Delay line with the interpolation as a policy. While nothing is modulated every read is a whole number of
+ samples back, but each interpolator has its own latency, which read adds to the delay asked for. So besides
+ the cost, the interpolator shifts every delay a little, and with them the network's modes.
+ */
+template <template <typename> class Interpolator>
+using InterpolatedDelay = signalsmith::delay::Delay<float, Interpolator>;
+
+/**
+ signalsmith's 4-point Kaiser-sinc interpolator, with one kernel shared by every delay line in the process.
+ signalsmith's own keeps a copy of the kernel in each Delay, although the kernel never changes.
+ */
+template <typename Sample>
+class SharedKaiserSinc4
+{
+public:
+    using Kernel = signalsmith::delay::InterpolatorKaiserSincN<Sample, 4>;
+
+    static constexpr int inputLength { Kernel::inputLength };
+    static constexpr Sample latency { Kernel::latency };
+
+    template <typename Data>
+    Sample fractional (const Data& data, Sample fraction) const
+    {
+        return kernel.fractional (data, fraction);
+    }
+
+    /// Bytes the shared kernel holds, once for the whole process
+    static size_t getKernelBytes() { return kernel.coefficients.size() * sizeof (Sample); }
+
+private:
+    // Built during static initialisation, so the audio thread never waits on it
+    static inline const Kernel kernel {};
+};
+
+using Delay = InterpolatedDelay<SharedKaiserSinc4>;
+
+/**
+ Bytes a delay line allocates. resize rounds the buffer up to a power of two, with room for the
+ interpolator's inputs on top of the capacity asked for.
+ */
+template <typename DelayType>
+struct DelayMemory;
+
+template <template <typename> class Interpolator>
+struct DelayMemory<InterpolatedDelay<Interpolator>>
+{
+    /// @param capacity what the delay line is resized to
+    static size_t getBytes (int capacity)
+    {
+        return static_cast<size_t> (juce::nextPowerOfTwo (capacity + Interpolator<float>::inputLength)) * sizeof (float);
+    }
 
+    /**
+     @returns the bytes of the interpolation kernel, which every delay line of this type shares. Nearest and
+     linear interpolation have none.
+     */
+    static size_t getKernelBytes()
+    {
+        if constexpr (std::is_same_v<Interpolator<float>, SharedKaiserSinc4<float>>)
+            return SharedKaiserSinc4<float>::getKernelBytes();
+        else
+            return 0;
+    }
+};
+
+/**
+ Biquad low pass that is safe to retune from the audio thread. juce::IIRFilter takes a SpinLock whenever
+ its coefficients change, so this keeps its own copy of the coefficients and runs the same transposed
+ direct form II as juce::IIRFilter::processSingleSampleRaw.
+ */
 class SinglePoleLowPass
 {
 public:
@@ -89,24 +165,44 @@ public:
         calcCutoff (2000.0f);
     }
 
+    // b0, b1, b2, a1, a2, normalised by a0
+    using Coefficients = std::array<float, 5>;
+
+    static Coefficients makeCoefficients (float theSampleRate, float freq)
+    {
+        const auto coeffs { juce::IIRCoefficients::makeLowPass (theSampleRate, freq, 0.7071) };
+        Coefficients result;
+        std::copy (std::begin (coeffs.coefficients), std::end (coeffs.coefficients), result.begin());
+        return result;
+    }
+
     void calcCutoff (float freq)
     {
-        const auto coeffs { juce::IIRCoefficients::makeLowPass (sampleRate, freq, 0.7071) };
-        juceFilter.setCoefficients (coeffs);
+        coefficients = makeCoefficients (sampleRate, freq);
+    }
+
+    /// For filters that share a cutoff, to work the coefficients out once for all of them
+    void setCoefficients (const Coefficients& newCoefficients)
+    {
+        coefficients = newCoefficients;
     }
 
     float process (float sample)
     {
-        return juceFilter.processSingleSampleRaw (sample);
+        const auto out { coefficients[0] * sample + v1 };
+        v1 = coefficients[1] * sample - coefficients[3] * out + v2;
+        v2 = coefficients[2] * sample - coefficients[4] * out;
+        return out;
     }
+
+    void reset() { v1 = v2 = 0.0f; }
+
     float sampleRate { 44100 };
 
 private:
-    juce::IIRFilter juceFilter;
-
-    float a0;
-    float b0;
-    float output;
+    Coefficients coefficients {};
+    float v1 { 0.0f };
+    float v2 { 0.0f };
 };
 
 class TriangleModulator
@@ -147,7 +243,7 @@ private:
     int currentSampleIdx { 0 };
 };
 
-template <int channels = NUM_CHANNELS>
+template <int channels = NUM_CHANNELS, typename DelayType = Delay>
 class MultiMixedFeedback
 {
 public:
@@ -158,14 +254,28 @@ public:
 
     void setDecayGain (float gain)
     {
-        if (decayGain < 1.0f)
-            decayGain = gain;
+        decayGain = gain;
+    }
+
+    /**
+     @brief Crossfade towards an infinite hold: at 1 the input is muted and the loop is lossless, with unity
+     gain and the low pass bypassed, so whatever is in the delays recirculates for ever.
+     */
+    void setFreezeAmount (float amount)
+    {
+        freezeAmount = amount;
     }
 
     void setLpCutoff (float freq)
     {
+        if (freq == lpCutoff)
+            return;
+
+        // Every channel has the same cutoff, so the coefficients are worked out once per update
+        lpCutoff = freq;
+        const auto coefficients { SinglePoleLowPass::makeCoefficients (sampleRate, freq) };
         for (auto& filt : lowPassFilters)
-            filt.calcCutoff (freq);
+            filt.setCoefficients (coefficients);
     }
 
     void setModulatorAmplitudes (int amp)
@@ -180,20 +290,52 @@ public:
             modulators[i].setFrequency (i + freqInHz);
     }
 
+    /// Length of each channel's delay line, in samples
+    using Taps = std::array<int, channels>;
+
+    /**
+     @returns the delay lengths for a sample rate, spread exponentially over 1.5 octaves
+     */
+    static Taps makeTaps (float theSampleRate)
+    {
+        const auto delaySamplesBase { 100.0f * 0.001 * theSampleRate };
+        Taps taps;
+        for (int i = 0; i < channels; ++i)
+        {
+            const float r = i * 1.5 / channels;
+            taps[i] = std::pow (2, r) * delaySamplesBase;
+        }
+
+        return taps;
+    }
+
+    /// @returns the bytes configure allocates for these taps
+    static size_t getMemoryBytes (const Taps& taps)
+    {
+        size_t bytes { 0 };
+        for (auto length : taps)
+            bytes += DelayMemory<DelayType>::getBytes (length + 1);
+
+        return bytes;
+    }
+
+    /// @returns the bytes of the interpolation kernel the delay lines share
+    static size_t getKernelBytes() { return DelayMemory<DelayType>::getKernelBytes(); }
+
     /**
      @brief Setup the delay lines
      */
-    void configure (float theSampleRate)
+    void configure (float theSampleRate, const Taps& taps)
     {
         sampleRate = theSampleRate;
-        delaySamplesBase = 100.0f * 0.001 * sampleRate;
+        numDelaySamples = taps;
         for (int i = 0; i < channels; ++i)
         {
-            const float r = i * 1.5 / channels;
-            numDelaySamples[i] = std::pow (2, r) * delaySamplesBase;
             delays[i].resize (numDelaySamples[i] + 1);
             delays[i].reset();
             lowPassFilters[i].sampleRate = sampleRate;
+            lowPassFilters[i].calcCutoff (lpCutoff);
+            lowPassFilters[i].reset();
         }
 
         for (auto i = 0; i < channels; ++i)
@@ -203,6 +345,16 @@ public:
         setModulatorAmplitudes (15);
     }
 
+    /// Clears the delay lines and filters without reallocating them
+    void reset()
+    {
+        for (auto& delay : delays)
+            delay.reset();
+
+        for (auto& filt : lowPassFilters)
+            filt.reset();
+    }
+
     std::array<float, channels> process (std::array<float, channels> input)
     {
         std::array<float, channels> delayed;
@@ -222,10 +374,13 @@ public:
         Mixer::Householder<float, channels>::inPlace (delayedAndMixed.data());
 
         // Apply decay gain, add to input, and write back into delays
+        const auto inputGain { 1.0f - freezeAmount };
+        const auto loopGain { decayGain + (1.0f - decayGain) * freezeAmount };
         for (auto i = 0; i < channels; ++i)
         {
-            auto sum = input[i] + (decayGain * delayedAndMixed[i]);
-            delays[i].write (lowPassFilters[i].process (sum));
+            auto sum = inputGain * input[i] + (loopGain * delayedAndMixed[i]);
+            const auto filtered { lowPassFilters[i].process (sum) };
+            delays[i].write (filtered + freezeAmount * (sum - filtered));
         }
 
         return delayedAndMixed;
@@ -234,6 +389,7 @@ public:
 private:
     float delayMs { 200.0f };
     float decayGain { 0.1f };
+    float freezeAmount { 0.0f };
     float sampleRate { 44100.0f };
 
     std::array<int, channels> numDelaySamples;
@@ -241,39 +397,62 @@ private:
     std::array<TriangleModulator, channels> modulators;
     //#endif
     float modFreqMultiplier { 1.0f };
-    std::array<Delay, channels> delays;
-    float delaySamplesBase { 0.0f };
+    std::array<DelayType, channels> delays;
 
     // for lowpass
     std::array<SinglePoleLowPass, channels> lowPassFilters;
     float lpCutoff { 2000.0f };
 };
 
-template <int channels = NUM_CHANNELS>
+template <int channels = NUM_CHANNELS, typename DelayType = Delay>
 class DiffusionStep
 {
     using ChannelArray = std::array<float, channels>;
 
 public:
-    void setDelayMsRange (float delayRange)
+    struct Taps
     {
-        delayMsRange = delayRange;
-    }
+        std::array<int, channels> delaySamples;
+        std::array<bool, channels> flipPolarity;
+    };
 
-    void configure (float theSampleRate)
+    /**
+     @returns a random delay per channel, each from its own slice of the delay range, and random polarities
+     */
+    static Taps makeTaps (float delayMsRange, float theSampleRate, juce::Random& randomNumGenerator)
     {
-        sampleRate = theSampleRate;
-
-        const auto delaySamplesRange { delayMsRange * 0.001 * sampleRate };
+        Taps taps;
+        const auto delaySamplesRange { delayMsRange * 0.001 * theSampleRate };
         for (auto i = 0; i < channels; ++i)
         {
             const auto rangeLow = delaySamplesRange * i / channels;
             const auto rangeHigh = delaySamplesRange * (i + 1) / channels;
-            auto randomNumGenerator { juce::Random() };
-            delaySamples[i] = randomNumGenerator.nextInt ({ static_cast<int> (rangeLow), static_cast<int> (rangeHigh) });
+            // Many channels over a short range can leave a slice narrower than a sample
+            taps.delaySamples[i] = randomNumGenerator.nextInt ({ static_cast<int> (rangeLow), juce::jmax (static_cast<int> (rangeLow) + 1, static_cast<int> (rangeHigh)) });
+            taps.flipPolarity[i] = randomNumGenerator.nextInt() % 2;
+        }
+
+        return taps;
+    }
+
+    /// @returns the bytes configure allocates for these taps
+    static size_t getMemoryBytes (const Taps& taps)
+    {
+        size_t bytes { 0 };
+        for (auto length : taps.delaySamples)
+            bytes += DelayMemory<DelayType>::getBytes (length + 1);
+
+        return bytes;
+    }
+
+    void configure (const Taps& taps)
+    {
+        delaySamples = taps.delaySamples;
+        flipPolarity = taps.flipPolarity;
+        for (auto i = 0; i < channels; ++i)
+        {
             delays[i].resize (delaySamples[i] + 1);
             delays[i].reset();
-            flipPolarity[i] = randomNumGenerator.nextInt() % 2;
         }
     }
 
@@ -299,30 +478,58 @@ public:
         return delayedAndMixed;
     }
 
-private:
-    float delayMsRange { 100.0f };
-    float sampleRate { 44100.0f };
+    void processBlock (ChannelArray* frames, int numFrames)
+    {
+        for (auto i = 0; i < numFrames; ++i)
+            frames[i] = process (frames[i]);
+    }
+
+    void reset()
+    {
+        for (auto& delay : delays)
+            delay.reset();
+    }
 
+private:
     std::array<int, channels> delaySamples;
-    std::array<Delay, channels> delays;
+    std::array<DelayType, channels> delays;
     std::array<bool, channels> flipPolarity;
 };
 
-template <int channels = NUM_CHANNELS, int stepCount = DIFF_STEPS>
+template <int channels = NUM_CHANNELS, int stepCount = DIFF_STEPS, typename DelayType = Delay>
 class HalfLengthChannelDiffuser
 {
     using ChannelArray = std::array<float, channels>;
 
 public:
+    using Step = DiffusionStep<channels, DelayType>;
+    using Taps = std::array<typename Step::Taps, stepCount>;
+
+    /// Name of Reverb's trace span for this stage
+    static constexpr const char* traceName { "HalfLengthChannelDiffuser::process" };
+
     HalfLengthChannelDiffuser (float diffusionMs)
     {
         updateDiffusionMs (50.0f);
     }
 
-    void configure (float sampleRate)
+    /// @returns taps for every step, with each step's delay range half that of the step before
+    static Taps makeTaps (float diffusionMs, float sampleRate, juce::Random& randomNumGenerator)
     {
-        for (auto& step : steps)
-            step.configure (sampleRate);
+        Taps taps;
+        for (auto i = 0; i < stepCount; ++i)
+        {
+            diffusionMs *= 0.5;
+            taps[i] = Step::makeTaps (diffusionMs, sampleRate, randomNumGenerator);
+        }
+
+        return taps;
+    }
+
+    void configure (const Taps& taps)
+    {
+        for (auto i = 0; i < stepCount; ++i)
+            steps[i].configure (taps[i]);
     }
 
     ChannelArray process (ChannelArray input)
@@ -333,20 +540,481 @@ public:
         return input;
     }
 
-    void updateDiffusionMs (float diffusionMs)
+    /** Runs the whole block through each step in turn, so only one step's delay lines are in use at a time */
+    void processBlock (ChannelArray* frames, int numFrames)
     {
         for (auto& step : steps)
+            step.processBlock (frames, numFrames);
+    }
+
+    /// Clears the delay lines without reallocating them
+    void reset()
+    {
+        for (auto& step : steps)
+            step.reset();
+    }
+
+    float getDiffusionMs() const { return diffusionMs; }
+
+    /// Takes effect the next time the taps are made
+    void updateDiffusionMs (float newDiffusionMs)
+    {
+        diffusionMs = newDiffusionMs;
+    };
+
+    /// @returns how long an impulse takes to get through every step. There's no feedback, so this doesn't depend on thresholdDb.
+    static int getTailSamples (const Taps& taps, float /*thresholdDb*/)
+    {
+        auto tailSamples { 0 };
+        for (const auto& step : taps)
+            tailSamples += *std::max_element (step.delaySamples.begin(), step.delaySamples.end());
+
+        return tailSamples;
+    }
+
+    /// @returns the total length of the delay lines, in samples
+    static int getDelaySamples (const Taps& taps)
+    {
+        auto delaySamples { 0 };
+        for (const auto& step : taps)
+            for (auto length : step.delaySamples)
+                delaySamples += length + 1;
+
+        return delaySamples;
+    }
+
+    /// @returns the bytes configure allocates for these taps, which is more than getDelaySamples as each line is rounded up to a power of two
+    static size_t getMemoryBytes (const Taps& taps)
+    {
+        size_t bytes { 0 };
+        for (const auto& step : taps)
+            bytes += Step::getMemoryBytes (step);
+
+        return bytes;
+    }
+
+    /// @returns the bytes of the interpolation kernel the delay lines share
+    static size_t getKernelBytes() { return DelayMemory<DelayType>::getKernelBytes(); }
+
+private:
+    std::array<Step, stepCount> steps;
+    float diffusionMs { 50.0f };
+};
+
+/**
+ Diffuser made of nested Schroeder allpasses, a chain of stageCount per channel. Each stage is an allpass
+ with another allpass inside its delay path, so one stage already recirculates into a dense series of
+ echoes, and there's no mixing matrix between stages. Every delay line is a slice of one buffer sized to
+ exactly what the taps need, which comes to a fraction of HalfLengthChannelDiffuser's memory.
+
+ Use it by passing it to Reverb as the diffuser, e.g. `Reverb<8, 6, NestedAllpassDiffuser<8>>`.
+ */
+template <int channels = NUM_CHANNELS, int stageCount = 4>
+class NestedAllpassDiffuser
+{
+    using ChannelArray = std::array<float, channels>;
+
+public:
+    /// Delay round each loop of one channel's stage. The outer loop includes the inner allpass.
+    struct Stage
+    {
+        int outerSamples;
+        int innerSamples;
+    };
+
+    using Taps = std::array<std::array<Stage, channels>, stageCount>;
+
+    /// Feedback (and feedforward) gain of every allpass
+    static constexpr float allpassGain { 0.6f };
+
+    /// Name of Reverb's trace span for this stage
+    static constexpr const char* traceName { "NestedAllpassDiffuser::process" };
+
+    NestedAllpassDiffuser (float theDiffusionMs)
+        : diffusionMs (theDiffusionMs)
+    {
+    }
+
+    /**
+     @returns random loop lengths for every stage, with each channel's from its own slice of the stage's range.
+     The first stage's range is a quarter of diffusionMs and each later stage's is half the one before, as
+     the recirculation makes up for the shorter delays.
+     */
+    static Taps makeTaps (float diffusionMs, float sampleRate, juce::Random& randomNumGenerator)
+    {
+        Taps taps;
+        auto rangeSamples { diffusionMs * 0.001f * sampleRate * 0.25f };
+        for (auto& stage : taps)
         {
-            diffusionMs *= 0.5;
-            step.setDelayMsRange (diffusionMs);
+            for (auto i = 0; i < channels; ++i)
+            {
+                const auto rangeLow { static_cast<int> (rangeSamples * i / channels) };
+                const auto rangeHigh { static_cast<int> (rangeSamples * (i + 1) / channels) };
+                const auto outerSamples { juce::jmax (3, randomNumGenerator.nextInt ({ rangeLow, juce::jmax (rangeLow + 1, rangeHigh) })) };
+
+                // Keep the inner loop well short of the outer one, and not a simple ratio of it
+                const auto innerSamples { juce::jlimit (1, outerSamples - 2, static_cast<int> (outerSamples * (0.3f + 0.15f * randomNumGenerator.nextFloat()))) };
+                stage[i] = { outerSamples, innerSamples };
+            }
+
+            rangeSamples *= 0.5f;
         }
+
+        return taps;
+    }
+
+    void configure (const Taps& taps)
+    {
+        auto offset { 0 };
+        for (auto s = 0; s < stageCount; ++s)
+        {
+            for (auto i = 0; i < channels; ++i)
+            {
+                const auto& stage { taps[s][i] };
+                lines[s][i].outer = { offset, stage.outerSamples - stage.innerSamples, 0 };
+                offset += lines[s][i].outer.length;
+                lines[s][i].inner = { offset, stage.innerSamples, 0 };
+                offset += lines[s][i].inner.length;
+            }
+        }
+
+        buffer.assign (static_cast<size_t> (offset), 0.0f);
+    }
+
+    ChannelArray process (ChannelArray input)
+    {
+        processBlock (&input, 1);
+        return input;
+    }
+
+    /** Runs the whole block through each stage in turn, so only one stage's delay lines are in use at a time */
+    void processBlock (ChannelArray* frames, int numFrames)
+    {
+        constexpr auto g { allpassGain };
+
+        for (auto& stage : lines)
+        {
+            for (auto n = 0; n < numFrames; ++n)
+            {
+                for (auto i = 0; i < channels; ++i)
+                {
+                    auto& outerSlot { stage[i].outer.slot (buffer) };
+                    auto& innerSlot { stage[i].inner.slot (buffer) };
+
+                    // The inner allpass is fed from the end of the outer delay...
+                    const auto innerState { outerSlot + g * innerSlot };
+                    const auto innerOut { innerSlot - g * innerState };
+                    innerSlot = innerState;
+
+                    // ...and the outer allpass wraps round both
+                    const auto outerState { frames[n][i] + g * innerOut };
+                    frames[n][i] = innerOut - g * outerState;
+                    outerSlot = outerState;
+
+                    stage[i].outer.advance();
+                    stage[i].inner.advance();
+                }
+            }
+        }
+    }
+
+    /// Clears the delay lines without reallocating them
+    void reset()
+    {
+        std::fill (buffer.begin(), buffer.end(), 0.0f);
+    }
+
+    float getDiffusionMs() const { return diffusionMs; }
+
+    /// Takes effect the next time the taps are made
+    void updateDiffusionMs (float newDiffusionMs)
+    {
+        diffusionMs = newDiffusionMs;
+    }
+
+    /// @returns roughly how long an impulse takes to decay by thresholdDb (which is negative) through every stage
+    static int getTailSamples (const Taps& taps, float thresholdDb)
+    {
+        const auto loops { thresholdDb / (20.0f * std::log10 (allpassGain)) };
+
+        auto tailSamples { 0.0f };
+        for (const auto& stage : taps)
+        {
+            const auto longest { std::max_element (stage.begin(), stage.end(), [] (const auto& a, const auto& b) { return a.outerSamples < b.outerSamples; }) };
+            tailSamples += longest->outerSamples * loops;
+        }
+
+        return static_cast<int> (std::ceil (tailSamples));
+    }
+
+    /// @returns the total length of the delay lines, in samples
+    static int getDelaySamples (const Taps& taps)
+    {
+        auto delaySamples { 0 };
+        for (const auto& stage : taps)
+            for (const auto& channel : stage)
+                delaySamples += channel.outerSamples;
+
+        return delaySamples;
+    }
+
+    /// @returns the bytes configure allocates for these taps. The shared buffer holds exactly the delay lines.
+    static size_t getMemoryBytes (const Taps& taps)
+    {
+        return static_cast<size_t> (getDelaySamples (taps)) * sizeof (float);
+    }
+
+    /// The lines are read a whole number of samples back, so there's no interpolation kernel
+    static size_t getKernelBytes() { return 0; }
+
+private:
+    /// A delay line living in a slice of the shared buffer, delaying by exactly its length
+    struct Line
+    {
+        int offset { 0 };
+        int length { 1 };
+        int pos { 0 };
+
+        float& slot (std::vector<float>& buffer) const { return buffer[static_cast<size_t> (offset + pos)]; }
+
+        void advance()
+        {
+            if (++pos == length)
+                pos = 0;
+        }
+    };
+
+    struct StageLines
+    {
+        Line outer;
+        Line inner;
+    };
+
+    std::array<std::array<StageLines, channels>, stageCount> lines;
+    std::vector<float> buffer;
+    float diffusionMs { 50.0f };
+};
+
+/**
+ Early reflections: a sparse set of taps on one delay line shared by all of them. Each tap picks up the input
+ at its own delay and gain and feeds one channel of the network, so dozens of reflections cost one write and
+ a multiply-add per tap per sample, with no filters or feedback of their own.
+ */
+template <int channels = NUM_CHANNELS, int tapCount = 32>
+class EarlyReflections
+{
+    using ChannelArray = std::array<float, channels>;
+
+public:
+    struct Tap
+    {
+        int delaySamples;
+        float gain;
+        int channel;
     };
 
+    using Taps = std::array<Tap, tapCount>;
+
+    /// Range the reflections arrive over, after the direct sound
+    static constexpr float firstMs { 5.0f };
+    static constexpr float lastMs { 80.0f };
+
+    /**
+     @returns taps spread exponentially from firstMs to lastMs with some jitter, fading by 18dB over that time,
+     with random polarities and dealt round the channels in turn
+     */
+    static Taps makeTaps (float sampleRate, juce::Random& randomNumGenerator)
+    {
+        // So the reflections into each channel add up to about unity
+        const auto normalisation { std::sqrt (static_cast<float> (channels) / tapCount) };
+
+        Taps taps;
+        for (auto i = 0; i < tapCount; ++i)
+        {
+            const auto position { (i + randomNumGenerator.nextFloat()) / tapCount };
+            const auto ms { firstMs * std::pow (lastMs / firstMs, position) };
+            const auto gain { normalisation * juce::Decibels::decibelsToGain (-18.0f * position) };
+            taps[i] = { juce::jmax (1, static_cast<int> (ms * 0.001f * sampleRate)), randomNumGenerator.nextBool() ? gain : -gain, i % channels };
+        }
+
+        return taps;
+    }
+
+    /**
+     @param maxBlockSize the most samples processBlock will be asked for at once
+     */
+    void configure (const Taps& newTaps, int maxBlockSize)
+    {
+        taps = newTaps;
+
+        const auto length { getBufferLength (taps, maxBlockSize) };
+        buffer.assign (static_cast<size_t> (length), 0.0f);
+        mask = length - 1;
+        writePos = 0;
+    }
+
+    void reset()
+    {
+        std::fill (buffer.begin(), buffer.end(), 0.0f);
+    }
+
+    /// @returns the bytes configure allocates for these taps and block size
+    static size_t getMemoryBytes (const Taps& taps, int maxBlockSize)
+    {
+        return static_cast<size_t> (getBufferLength (taps, maxBlockSize)) * sizeof (float);
+    }
+
+    void setLevel (float newLevel) { level = newLevel; }
+
+    /// True if processBlock's output is worth adding in. The input is stored either way.
+    bool isActive() const { return level != 0.0f; }
+
+    /**
+     @brief Store a mono block and, if active, write the reflections of it to output, one frame per sample
+     */
+    void processBlock (const float* input, ChannelArray* output, int numSamples)
+    {
+        // The whole block goes in first, so each tap can then read its span of it in one pass
+        for (auto i = 0; i < numSamples; ++i)
+            buffer[static_cast<size_t> ((writePos + i) & mask)] = input[i];
+
+        if (isActive())
+        {
+            for (auto i = 0; i < numSamples; ++i)
+                output[i].fill (0.0f);
+
+            for (const auto& tap : taps)
+            {
+                const auto gain { tap.gain * level };
+                const auto readPos { writePos - tap.delaySamples };
+                for (auto i = 0; i < numSamples; ++i)
+                    output[i][tap.channel] += gain * buffer[static_cast<size_t> ((readPos + i) & mask)];
+            }
+        }
+
+        writePos = (writePos + numSamples) & mask;
+    }
+
 private:
-    std::array<DiffusionStep<channels>, stepCount> steps;
+    /// Room for the longest tap plus a whole block, rounded up to a power of two so positions can wrap with a mask
+    static int getBufferLength (const Taps& taps, int maxBlockSize)
+    {
+        auto longestDelay { 0 };
+        for (const auto& tap : taps)
+            longestDelay = juce::jmax (longestDelay, tap.delaySamples);
+
+        return juce::nextPowerOfTwo (longestDelay + maxBlockSize);
+    }
+
+    Taps taps;
+    std::vector<float> buffer;
+    int mask { 0 };
+    int writePos { 0 };
+    float level { 0.0f };
+};
+
+/**
+ Bytes a Reverb allocates, by stage
+ */
+struct ReverbMemoryUsage
+{
+    size_t diffuser { 0 };
+    size_t early { 0 };
+    size_t feedback { 0 };
+
+    /// The Reverb object itself, including its scratch frames for one block
+    size_t instance { 0 };
+
+    /**
+     The taps, which every Reverb with the same configuration shares. Adding usages sums them, so only add
+     up reverbs with different tables, such as the left and right of an engine or different engines, and
+     leave them out for reverbs sharing tables that are already counted.
+     */
+    size_t tables { 0 };
+
+    /// The interpolation kernel, which one copy serves for the whole process
+    size_t kernels { 0 };
+
+    size_t getTotal() const { return diffuser + early + feedback + instance + tables + kernels; }
+
+    ReverbMemoryUsage& operator+= (const ReverbMemoryUsage& other)
+    {
+        diffuser += other.diffuser;
+        early += other.early;
+        feedback += other.feedback;
+        instance += other.instance;
+        tables += other.tables;
+
+        // There is only ever one kernel, however many reverbs use it
+        kernels = std::max (kernels, other.kernels);
+        return *this;
+    }
+};
+
+/**
+ The immutable part of a Reverb's configuration: its delay lengths, polarities and reflection taps
+ */
+template <typename DiffuserType, typename FeedbackType, typename EarlyType>
+struct ReverbTables : public juce::ReferenceCountedObject
+{
+    using Ptr = juce::ReferenceCountedObjectPtr<ReverbTables>;
+
+    typename DiffuserType::Taps diffusionTaps;
+    typename FeedbackType::Taps feedbackTaps;
+    typename EarlyType::Taps earlyTaps;
+};
+
+/**
+ Process-wide cache of ReverbTables. Every Reverb configured with the same sample rate, diffusion time and
+ variant shares one set of tables, so only the first instance pays for generating them. Entries are dropped
+ once no Reverb holds them any more.
+ */
+template <typename Tables>
+class SharedTableCache
+{
+public:
+    struct Key
+    {
+        float sampleRate;
+        float diffusionMs;
+        int variant;
+
+        bool operator== (const Key& other) const
+        {
+            return sampleRate == other.sampleRate && diffusionMs == other.diffusionMs && variant == other.variant;
+        }
+    };
+
+    /**
+     @param createTables called with the lock held if there is no entry for the key, returning a new Tables
+     */
+    template <typename CreateFn>
+    static typename Tables::Ptr get (const Key& key, CreateFn&& createTables)
+    {
+        static std::mutex mutex;
+        static std::vector<std::pair<Key, typename Tables::Ptr>> entries;
+
+        const std::lock_guard<std::mutex> lock (mutex);
+
+        // Only the cache is holding these, so nobody is using them
+        entries.erase (std::remove_if (entries.begin(), entries.end(), [] (const auto& entry) { return entry.second->getReferenceCount() == 1; }),
+            entries.end());
+
+        for (const auto& entry : entries)
+            if (entry.first == key)
+                return entry.second;
+
+        entries.emplace_back (key, createTables());
+        return entries.back().second;
+    }
 };
 
-template <int channels = NUM_CHANNELS, int diffusionSteps = DIFF_STEPS>
+/**
+ @tparam Diffuser the diffusion stage in front of the feedback network: HalfLengthChannelDiffuser, or
+ NestedAllpassDiffuser for one that uses less memory
+ @tparam FeedbackDelay the delay line in the feedback network, which sets its interpolation
+ */
+template <int channels = NUM_CHANNELS, int diffusionSteps = DIFF_STEPS, typename Diffuser = HalfLengthChannelDiffuser<channels, diffusionSteps>, typename FeedbackDelay = Delay>
 class Reverb
 {
     using ChannelArray = std::array<float, channels>;
@@ -355,14 +1023,41 @@ public:
     Reverb (float theRoomSizeMs, float theRt60, float dry = 0, float wet = 1)
         : diffuser (theRoomSizeMs)
     {
+        feedback.setLpCutoff (lpFreq);
         updateParams();
     }
 
-    void configure (float sampleRate)
+    /**
+     @brief Size the delay lines for the given sample rate, starting from silence. Re-preparing at the rate
+     we're already configured for only clears the delay lines, so it doesn't reallocate anything.
+     @param variant picks a different set of delay taps, e.g. so left and right don't sound identical.
+     Reverbs with the same sample rate and variant share their tables.
+     */
+    void configure (float newSampleRate, int variant = 0)
+    {
+        if (isConfigured && newSampleRate == sampleRate && variant == tableVariant)
+        {
+            reset();
+            return;
+        }
+
+        tables = getSharedTables (newSampleRate, diffuser.getDiffusionMs(), variant);
+        feedback.configure (newSampleRate, tables->feedbackTaps);
+        diffuser.configure (tables->diffusionTaps);
+        early.configure (tables->earlyTaps, blockSize);
+        freezeAmount.reset (newSampleRate, freezeRampSeconds);
+        sampleRate = newSampleRate;
+        tableVariant = variant;
+        isConfigured = true;
+    }
+
+    /// Silences the tail without reallocating anything, so it's safe on the audio thread
+    void reset()
     {
-        feedback.configure (sampleRate);
-        diffuser.configure (sampleRate);
-        sampleRate = sampleRate;
+        feedback.reset();
+        diffuser.reset();
+        early.reset();
+        diffuserNeedsReset = false;
     }
 
     ChannelArray process (ChannelArray input)
@@ -376,6 +1071,86 @@ public:
         return output;
     }
 
+    /**
+     @brief Process a mono block: the input is fed to every channel of the network and the output is the
+     mixdown of all channels. Works through the block blockSize samples at a time, running each stage over
+     the whole sub-block before moving on to the next.
+     */
+    void processBlock (const float* input, float* output, int numSamples)
+    {
+        TRACE_SCOPE ("Reverb::process");
+
+        for (auto start = 0; start < numSamples; start += blockSize)
+            processSubBlock (input + start, output + start, juce::jmin (blockSize, numSamples - start));
+    }
+
+    /// Largest number of samples each stage processes in one go
+    static constexpr int blockSize { 64 };
+
+    /// How much of one input goes into each channel of the network
+    using InjectionGains = ChannelArray;
+
+    /**
+     @returns injection gains for an input at the given level, panned from the first half of the network's
+     channels (-1) to the second half (1). Centred, every channel gets the input at that level, the same as
+     in processBlock.
+     */
+    static InjectionGains makeInjectionGains (float gain, float pan = 0.0f)
+    {
+        const auto angle { (juce::jlimit (-1.0f, 1.0f, pan) + 1.0f) * juce::MathConstants<float>::pi / 4.0f };
+        const auto firstHalf { gain * juce::MathConstants<float>::sqrt2 * std::cos (angle) };
+        const auto secondHalf { gain * juce::MathConstants<float>::sqrt2 * std::sin (angle) };
+
+        InjectionGains gains;
+        for (auto i = 0; i < channels; ++i)
+            gains[i] = i < channels / 2 ? firstHalf : secondHalf;
+
+        return gains;
+    }
+
+    /**
+     @brief Run several mono sends through the one network, e.g. stems sharing a reverb bus. Each input is
+     added into the network's channels scaled by its injection gains, so the diffuser and feedback run once
+     however many inputs there are. The output is the wet mixdown only, as there's no single dry signal.
+     */
+    void processSends (const float* const* inputs, const InjectionGains* injectionGains, int numInputs, float* output, int numSamples)
+    {
+        TRACE_SCOPE ("Reverb::processSends");
+
+        for (auto start = 0; start < numSamples; start += blockSize)
+        {
+            const auto numToProcess { juce::jmin (blockSize, numSamples - start) };
+
+            {
+                TRACE_SCOPE ("Reverb::inject");
+                for (auto i = 0; i < numToProcess; ++i)
+                    frames[i].fill (0.0f);
+
+                for (auto input = 0; input < numInputs; ++input)
+                {
+                    const auto* source { inputs[input] + start };
+                    const auto& gains { injectionGains[input] };
+                    for (auto i = 0; i < numToProcess; ++i)
+                        for (auto channel = 0; channel < channels; ++channel)
+                            frames[i][channel] += gains[channel] * source[i];
+                }
+
+                // The early reflections take a mono feed
+                for (auto i = 0; i < numToProcess; ++i)
+                {
+                    auto sum { 0.0f };
+                    for (auto sample : frames[i])
+                        sum += sample;
+
+                    sendMix[i] = sum / channels;
+                }
+            }
+
+            processFrames (sendMix.data(), numToProcess);
+            mixdown (nullptr, output + start, numToProcess);
+        }
+    }
+
     void setWet (float wetAmount) { wet = wetAmount; }
     void setDry (float dryAmount) { dry = dryAmount; }
 
@@ -400,39 +1175,264 @@ public:
         lpFreq = freq;
     }
 
+    /// Level of the early reflections, both in the output and into the feedback network. 0 turns them off.
+    void setEarlyLevel (float level) { early.setLevel (level); }
+
+    /**
+     @brief Hold the current tail indefinitely. The input to the network fades out and the feedback fades to
+     lossless over freezeRampSeconds, and back again on release. Once fully frozen the diffuser is skipped,
+     as its output would only be muted. The dry signal is unaffected.
+     */
+    void setFreeze (bool shouldFreeze)
+    {
+        freezeAmount.setTargetValue (shouldFreeze ? 1.0f : 0.0f);
+    }
+
+    static constexpr double freezeRampSeconds { 0.05 };
+
     void setDelayModulation (int freqInHz, int amplitude)
     {
         feedback.setModulatorFrequencies (freqInHz);
         feedback.setModulatorAmplitudes (amplitude);
     }
 
+#if PERF_INSTRUMENTATION
+    /** @returns the cycles spent per stage since the last call, and resets the counters */
+    Perf::StageCycles takeStageCycles()
+    {
+        return std::exchange (stageCycles, {});
+    }
+#endif
+
+    using FeedbackType = MultiMixedFeedback<channels, FeedbackDelay>;
+    using DiffuserType = Diffuser;
+    using EarlyType = EarlyReflections<channels>;
+    using Tables = ReverbTables<DiffuserType, FeedbackType, EarlyType>;
+
+    /**
+     @returns the tables every Reverb with this configuration shares, creating them if need be. The random
+     taps are drawn from a generator seeded with the variant, so the same configuration always sounds the
+     same, in every instance and every run.
+     */
+    static typename Tables::Ptr getSharedTables (float sampleRate, float diffusionMs, int variant)
+    {
+        return SharedTableCache<Tables>::get ({ sampleRate, diffusionMs, variant }, [sampleRate, diffusionMs, variant] {
+            return makeTables (sampleRate, diffusionMs, variant);
+        });
+    }
+
+    /// @returns new tables for the configuration, without going through the cache
+    static typename Tables::Ptr makeTables (float sampleRate, float diffusionMs, int variant)
+    {
+        juce::Random randomNumGenerator { tapSeed + variant };
+
+        typename Tables::Ptr newTables { new Tables() };
+        newTables->diffusionTaps = DiffuserType::makeTaps (diffusionMs, sampleRate, randomNumGenerator);
+        newTables->feedbackTaps = FeedbackType::makeTaps (sampleRate);
+        newTables->earlyTaps = EarlyType::makeTaps (sampleRate, randomNumGenerator);
+        return newTables;
+    }
+
+    /// @returns the tables configure picked, or null if it hasn't been called
+    typename Tables::Ptr getTables() const { return tables; }
+
+    /// Seed for variant 0's taps. Changing it changes how every render sounds, so the verification references have to be remade.
+    static constexpr juce::int64 tapSeed { 0x5468655665726231 };
+
+    /**
+     @returns what this reverb allocates, by stage, once configured for the sample rate and variant. If it's
+     already configured that way, that's what its tables allocated. Otherwise it's worked out from the tables
+     configure would make, without allocating any delay lines or touching the shared cache, so a configuration
+     can be checked against a memory budget first.
+     */
+    ReverbMemoryUsage getMemoryUsage (float forSampleRate, int variant = 0) const
+    {
+        const auto isCurrent { isConfigured && forSampleRate == sampleRate && variant == tableVariant };
+        const auto forTables { isCurrent ? tables : makeTables (forSampleRate, diffuser.getDiffusionMs(), variant) };
+
+        ReverbMemoryUsage usage;
+        usage.diffuser = DiffuserType::getMemoryBytes (forTables->diffusionTaps);
+        usage.early = EarlyType::getMemoryBytes (forTables->earlyTaps, blockSize);
+        usage.feedback = FeedbackType::getMemoryBytes (forTables->feedbackTaps);
+        usage.instance = sizeof (*this);
+        usage.tables = sizeof (Tables);
+        usage.kernels = std::max (DiffuserType::getKernelBytes(), FeedbackType::getKernelBytes());
+        return usage;
+    }
+
+    /// True when nothing in the network is modulated, so the output is a linear, time-invariant function of the input
+    static constexpr bool isTimeInvariant { DELAY_MOD == 0 };
+
+    /**
+     @returns an upper bound on how many samples an impulse takes to decay by thresholdDb (which is negative),
+     or -1 if the network isn't decaying. Only valid once configured.
+     */
+    int getTailSamples (float thresholdDb) const
+    {
+        const auto decayGain { calcDecayGain (roomSizeMs, rt60) };
+        if (decayGain >= 1.0f)
+            return -1;
+
+        // Every trip round the feedback loop multiplies by the decay gain and takes at most the longest delay
+        const auto longestDelay { *std::max_element (tables->feedbackTaps.begin(), tables->feedbackTaps.end()) };
+        const auto trips { 1.0f + (thresholdDb / 20.0f) / std::log10 (decayGain) };
+
+        // The early reflections feed the network too, so the last of them starts a tail of its own
+        const auto lastReflection { std::max_element (tables->earlyTaps.begin(), tables->earlyTaps.end(), [] (const auto& a, const auto& b) { return a.delaySamples < b.delaySamples; }) };
+        const auto networkInputSamples { juce::jmax (DiffuserType::getTailSamples (tables->diffusionTaps, thresholdDb), lastReflection->delaySamples) };
+
+        return networkInputSamples + static_cast<int> (std::ceil (longestDelay * trips));
+    }
+
+    /// Feedback gain per trip round the loop for the network to decay by 60dB in (roughly) rt60 seconds
+    static float calcDecayGain (float roomSizeMs, float rt60)
+    {
+        // How long does our signal take to go around the feedback loop?
+        const auto typicalLoopMs { roomSizeMs * 2.5 };
+
+        // How many times will it do that during our RT60 period?
+        const auto loopsPerRt60 { (rt60 / 2) / (typicalLoopMs * 0.001) };
+
+        // This tells us how many dB to reduce per loop
+        const auto dbPerCycle = -60 / loopsPerRt60;
+
+        return std::pow (10, dbPerCycle * 0.8f);
+    }
+
+    /**
+     @returns the gain from the sum of the channels to the wet output. The channels carry roughly uncorrelated
+     signals of equal level, so their sum grows with the square root of the channel count; scaling by that
+     keeps every channel count at the level of the default NUM_CHANNELS.
+     */
+    static float getOutputGain()
+    {
+        return 1.0f / std::sqrt (static_cast<float> (channels * NUM_CHANNELS));
+    }
+
 private:
-    MultiMixedFeedback<channels> feedback;
-    HalfLengthChannelDiffuser<channels, diffusionSteps> diffuser;
+    FeedbackType feedback;
+    DiffuserType diffuser;
+    EarlyType early;
+    typename Tables::Ptr tables;
+
+    std::array<ChannelArray, blockSize> frames;
+    std::array<ChannelArray, blockSize> earlyFrames;
+    std::array<float, blockSize> sendMix;
+    std::array<float, blockSize> freezeValues;
 
     float wet { 1.0 };
     float dry { 0.0 };
 
+    juce::SmoothedValue<float> freezeAmount;
+    bool diffuserNeedsReset { false };
+
     float roomSizeMs { 50.0f };
     float rt60 { 12.0f };
     float sampleRate { 48000 };
     float lpFreq { 4000.0f };
+    int tableVariant { 0 };
+    bool isConfigured { false };
 
-    void updateParams()
+#if PERF_INSTRUMENTATION
+    Perf::StageCycles stageCycles;
+#endif
+
+    void processSubBlock (const float* input, float* output, int numSamples)
     {
-        diffuser.updateDiffusionMs (roomSizeMs);
+        for (auto i = 0; i < numSamples; ++i)
+            frames[i].fill (input[i]);
 
-        feedback.setDelayMs (roomSizeMs);
+        processFrames (input, numSamples);
+        mixdown (input, output, numSamples);
+    }
 
-        // How long does our signal take to go around the feedback loop?
-        const auto typicalLoopMs { roomSizeMs * 2.5 };
+    /// Runs the frames through the network, with monoInput feeding the early reflections
+    void processFrames (const float* monoInput, int numSamples)
+    {
+        if (freezeAmount.getTargetValue() == 1.0f && ! freezeAmount.isSmoothing())
+        {
+            // What's left in the diffuser would come out after the freeze rather than being flushed by the
+            // (muted) input, so clear it before it's next used
+            diffuserNeedsReset = true;
+        }
+        else
+        {
+            TRACE_SCOPE (DiffuserType::traceName);
+#if PERF_INSTRUMENTATION
+            Perf::ScopedCycleCounter counter (stageCycles.diffuser);
+#endif
+            if (std::exchange (diffuserNeedsReset, false))
+                diffuser.reset();
+
+            diffuser.processBlock (frames.data(), numSamples);
+        }
 
-        // How many times will it do that during our RT60 period?
-        const auto loopsPerRt60 { (rt60 / 2) / (typicalLoopMs * 0.001) };
+        for (auto i = 0; i < numSamples; ++i)
+            freezeValues[i] = freezeAmount.getNextValue();
 
-        // This tells us how many dB to reduce per loop
-        const auto dbPerCycle = -60 / loopsPerRt60;
+        {
+            TRACE_SCOPE ("EarlyReflections::process");
+#if PERF_INSTRUMENTATION
+            Perf::ScopedCycleCounter counter (stageCycles.early);
+#endif
+            early.processBlock (monoInput, earlyFrames.data(), numSamples);
+
+            if (early.isActive())
+            {
+                for (auto i = 0; i < numSamples; ++i)
+                {
+                    // Muted along with the rest of the input when frozen
+                    const auto inputGain { 1.0f - freezeValues[i] };
+                    for (auto channel = 0; channel < channels; ++channel)
+                    {
+                        earlyFrames[i][channel] *= inputGain;
+                        frames[i][channel] += earlyFrames[i][channel];
+                    }
+                }
+            }
+        }
+
+        {
+            TRACE_SCOPE ("MultiMixedFeedback::process");
+#if PERF_INSTRUMENTATION
+            Perf::ScopedCycleCounter counter (stageCycles.feedback);
+#endif
+            for (auto i = 0; i < numSamples; ++i)
+            {
+                feedback.setFreezeAmount (freezeValues[i]);
+                frames[i] = feedback.process (frames[i]);
+            }
+        }
+    }
 
-        feedback.setDecayGain (std::pow (10, dbPerCycle * 0.8f));
+    /// Sums the frames into output, adding the dry input unless it's null
+    void mixdown (const float* input, float* output, int numSamples)
+    {
+        TRACE_SCOPE ("Reverb::mixdown");
+#if PERF_INSTRUMENTATION
+        Perf::ScopedCycleCounter counter (stageCycles.mixdown);
+#endif
+        const auto wetGain { wet * getOutputGain() };
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            auto sum { 0.0f };
+            for (auto sample : frames[i])
+                sum += sample;
+
+            if (early.isActive())
+                for (auto sample : earlyFrames[i])
+                    sum += sample;
+
+            // Written last, so processing in place is fine
+            output[i] = (input != nullptr ? dry * input[i] : 0.0f) + wetGain * sum;
+        }
+    }
+
+    void updateParams()
+    {
+        diffuser.updateDiffusionMs (roomSizeMs);
+
+        feedback.setDelayMs (roomSizeMs);
+        feedback.setDecayGain (calcDecayGain (roomSizeMs, rt60));
     }
 };
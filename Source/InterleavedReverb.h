@@ -0,0 +1,315 @@
+#pragma once
+
+#include "DspComponents.h"
+
+/**
+ Delay line holding one sample per lane at each position, so a read or write moves a whole lane vector.
+ Only integer delays, which is all the network uses while DELAY_MOD is off. Unlike Delay, a read adds no
+ interpolator latency: read (0) returns the last write.
+ */
+template <int lanes>
+class InterleavedDelay
+{
+public:
+    using LaneVector = std::array<float, lanes>;
+
+    void resize (int minCapacity)
+    {
+        const auto length { juce::nextPowerOfTwo (minCapacity + 1) };
+        buffer.assign (static_cast<size_t> (length * lanes), 0.0f);
+        mask = length - 1;
+        writePos = 0;
+    }
+
+    void reset()
+    {
+        std::fill (buffer.begin(), buffer.end(), 0.0f);
+    }
+
+    void write (const LaneVector& input)
+    {
+        writePos = (writePos + 1) & mask;
+        std::copy (input.begin(), input.end(), buffer.data() + writePos * lanes);
+    }
+
+    void read (int delaySamples, LaneVector& output) const
+    {
+        const auto* src { buffer.data() + ((writePos - delaySamples) & mask) * lanes };
+        std::copy (src, src + lanes, output.begin());
+    }
+
+private:
+    std::vector<float> buffer;
+    int mask { 0 };
+    int writePos { 0 };
+};
+
+/**
+ Lanes per vector register on the target: 4 for SSE and NEON, 8 for AVX2, 16 for AVX-512. Neither jucer
+ project sets architecture flags, so builds get 4 unless -mavx2 or -mavx512f is added to the compiler flags.
+ */
+#if defined(__AVX512F__)
+static constexpr int interleavedNativeLanes { 16 };
+static constexpr const char* interleavedTargetName { "AVX-512" };
+#elif defined(__AVX2__)
+static constexpr int interleavedNativeLanes { 8 };
+static constexpr const char* interleavedTargetName { "AVX2" };
+#elif defined(__AVX__)
+static constexpr int interleavedNativeLanes { 8 };
+static constexpr const char* interleavedTargetName { "AVX" };
+#else
+static constexpr int interleavedNativeLanes { 4 };
+static constexpr const char* interleavedTargetName { "SSE/NEON" };
+#endif
+
+/**
+ Runs `lanes` independent copies of Reverb<channels, stepCount> side by side, one instance per lane. All
+ the instances share their taps and parameters, so every delay read, mixer butterfly and filter update is
+ the same operation on a contiguous vector of lanes, with no shuffling between them. The lane loops are
+ plain loops the compiler vectorises to whatever the target supports; interleavedNativeLanes matches that width.
+
+ Output matches Reverb<channels, stepCount> configured with the same variant to within rounding, apart from
+ DELAY_MOD and freezing, which this engine doesn't support. Reverb's diffusion and feedback delays
+ interpolate, which adds Delay's latency to each of them, so the same delays here are read that much further
+ back. At whole-sample positions the interpolator only passes the sample through, up to rounding.
+ */
+template <int lanes, int channels = NUM_CHANNELS, int stepCount = DIFF_STEPS>
+class InterleavedReverb
+{
+    using LaneVector = std::array<float, lanes>;
+    using Frame = std::array<LaneVector, channels>;
+    using Tables = typename Reverb<channels, stepCount>::Tables;
+
+    /// What Delay's interpolator adds to every read in Reverb's diffusion and feedback delays
+    static constexpr int delayLatency { static_cast<int> (Delay::latency) };
+    static_assert (Delay::latency == delayLatency, "Delay's latency has to be a whole number of samples to match it with integer reads");
+
+public:
+    void configure (float newSampleRate, int variant = 0)
+    {
+        sampleRate = newSampleRate;
+        tables = Reverb<channels, stepCount>::getSharedTables (sampleRate, diffusionMs, variant);
+
+        for (auto step = 0; step < stepCount; ++step)
+        {
+            for (auto i = 0; i < channels; ++i)
+            {
+                diffusionDelays[step][i].resize (tables->diffusionTaps[step].delaySamples[i] + delayLatency + 1);
+                diffusionDelays[step][i].reset();
+            }
+        }
+
+        auto lastReflection { 0 };
+        for (const auto& tap : tables->earlyTaps)
+            lastReflection = juce::jmax (lastReflection, tap.delaySamples);
+
+        earlyDelay.resize (lastReflection + 1);
+        earlyDelay.reset();
+
+        for (auto i = 0; i < channels; ++i)
+        {
+            feedbackDelays[i].resize (tables->feedbackTaps[i] + delayLatency + 1);
+            feedbackDelays[i].reset();
+            filterV1[i].fill (0.0f);
+            filterV2[i].fill (0.0f);
+        }
+
+        calcFilterCoefficients();
+    }
+
+    /**
+     @brief Process one mono block per lane, the same way Reverb::processBlock does. Processing in place is fine.
+     */
+    void processBlock (const float* const* inputs, float* const* outputs, int numSamples)
+    {
+        TRACE_SCOPE ("InterleavedReverb::process");
+
+        const auto wetGain { wet * Reverb<channels, stepCount>::getOutputGain() };
+        for (auto n = 0; n < numSamples; ++n)
+        {
+            LaneVector input;
+            for (auto lane = 0; lane < lanes; ++lane)
+                input[lane] = inputs[lane][n];
+
+            Frame frame;
+            frame.fill (input);
+
+            diffuse (frame);
+
+            Frame earlyFrame {};
+            earlyDelay.write (input);
+            if (earlyLevel != 0.0f)
+            {
+                reflect (earlyFrame);
+                for (auto i = 0; i < channels; ++i)
+                    for (auto lane = 0; lane < lanes; ++lane)
+                        frame[i][lane] += earlyFrame[i][lane];
+            }
+
+            feedback (frame);
+
+            LaneVector sum {};
+            for (const auto& channel : frame)
+                for (auto lane = 0; lane < lanes; ++lane)
+                    sum[lane] += channel[lane];
+
+            if (earlyLevel != 0.0f)
+                for (const auto& channel : earlyFrame)
+                    for (auto lane = 0; lane < lanes; ++lane)
+                        sum[lane] += channel[lane];
+
+            for (auto lane = 0; lane < lanes; ++lane)
+                outputs[lane][n] = dry * input[lane] + wetGain * sum[lane];
+        }
+    }
+
+    void setWet (float wetAmount) { wet = wetAmount; }
+    void setDry (float dryAmount) { dry = dryAmount; }
+
+    void setRoomSizeMs (float size)
+    {
+        roomSizeMs = 101.0f - size;
+        decayGain = Reverb<channels, stepCount>::calcDecayGain (roomSizeMs, rt60);
+    }
+
+    void setRt60 (float theRt60)
+    {
+        rt60 = theRt60;
+        decayGain = Reverb<channels, stepCount>::calcDecayGain (roomSizeMs, rt60);
+    }
+
+    void setLpCutoff (float freq)
+    {
+        if (freq == lpFreq)
+            return;
+
+        lpFreq = freq;
+        calcFilterCoefficients();
+    }
+
+    void setEarlyLevel (float level) { earlyLevel = level; }
+
+private:
+    /// Same taps, in the same order, as EarlyReflections::processBlock
+    void reflect (Frame& earlyFrame) const
+    {
+        for (const auto& tap : tables->earlyTaps)
+        {
+            LaneVector delayed;
+            earlyDelay.read (tap.delaySamples, delayed);
+
+            const auto gain { tap.gain * earlyLevel };
+            for (auto lane = 0; lane < lanes; ++lane)
+                earlyFrame[tap.channel][lane] += gain * delayed[lane];
+        }
+    }
+
+    void diffuse (Frame& frame)
+    {
+        for (auto step = 0; step < stepCount; ++step)
+        {
+            const auto& taps { tables->diffusionTaps[step] };
+            for (auto i = 0; i < channels; ++i)
+            {
+                diffusionDelays[step][i].write (frame[i]);
+                diffusionDelays[step][i].read (taps.delaySamples[i] + delayLatency, frame[i]);
+            }
+
+            hadamard (frame);
+
+            for (auto i = 0; i < channels; ++i)
+                if (taps.flipPolarity[i])
+                    for (auto& sample : frame[i])
+                        sample = -sample;
+        }
+    }
+
+    void feedback (Frame& frame)
+    {
+        Frame delayed;
+        for (auto i = 0; i < channels; ++i)
+            feedbackDelays[i].read (tables->feedbackTaps[i] + delayLatency, delayed[i]);
+
+        // Householder: subtract 2/N of the sum from every channel
+        LaneVector sum {};
+        for (const auto& channel : delayed)
+            for (auto lane = 0; lane < lanes; ++lane)
+                sum[lane] += channel[lane];
+
+        for (auto& channel : delayed)
+            for (auto lane = 0; lane < lanes; ++lane)
+                channel[lane] += sum[lane] * (-2.0f / channels);
+
+        // Apply decay gain, add to input, filter and write back into the delays
+        const auto& c { filterCoefficients };
+        for (auto i = 0; i < channels; ++i)
+        {
+            LaneVector filtered;
+            for (auto lane = 0; lane < lanes; ++lane)
+            {
+                const auto in { frame[i][lane] + decayGain * delayed[i][lane] };
+                const auto out { c[0] * in + filterV1[i][lane] };
+                filterV1[i][lane] = c[1] * in - c[3] * out + filterV2[i][lane];
+                filterV2[i][lane] = c[2] * in - c[4] * out;
+                filtered[lane] = out;
+            }
+
+            feedbackDelays[i].write (filtered);
+        }
+
+        frame = delayed;
+    }
+
+    /// Same butterflies and scaling as Mixer::Hadamard, with each element a lane vector
+    static void hadamard (Frame& frame)
+    {
+        for (auto hSize = 1; hSize < channels; hSize *= 2)
+        {
+            for (auto start = 0; start < channels; start += 2 * hSize)
+            {
+                for (auto i = start; i < start + hSize; ++i)
+                {
+                    auto& a { frame[i] };
+                    auto& b { frame[i + hSize] };
+                    for (auto lane = 0; lane < lanes; ++lane)
+                    {
+                        const auto sum { a[lane] + b[lane] };
+                        b[lane] = a[lane] - b[lane];
+                        a[lane] = sum;
+                    }
+                }
+            }
+        }
+
+        const auto scalingFactor { static_cast<float> (std::sqrt (1.0 / channels)) };
+        for (auto& channel : frame)
+            for (auto& sample : channel)
+                sample *= scalingFactor;
+    }
+
+    void calcFilterCoefficients()
+    {
+        const auto coeffs { juce::IIRCoefficients::makeLowPass (sampleRate, lpFreq, 0.7071) };
+        std::copy (std::begin (coeffs.coefficients), std::end (coeffs.coefficients), filterCoefficients.begin());
+    }
+
+    typename Tables::Ptr tables;
+
+    std::array<std::array<InterleavedDelay<lanes>, channels>, stepCount> diffusionDelays;
+    std::array<InterleavedDelay<lanes>, channels> feedbackDelays;
+    InterleavedDelay<lanes> earlyDelay;
+
+    std::array<float, 5> filterCoefficients {};
+    std::array<LaneVector, channels> filterV1 {};
+    std::array<LaneVector, channels> filterV2 {};
+
+    float wet { 1.0 };
+    float dry { 0.0 };
+    float roomSizeMs { 50.0f };
+    float rt60 { 12.0f };
+    float diffusionMs { 50.0f };
+    float decayGain { Reverb<channels, stepCount>::calcDecayGain (50.0f, 12.0f) };
+    float sampleRate { 48000 };
+    float lpFreq { 4000.0f };
+    float earlyLevel { 0.0f };
+};
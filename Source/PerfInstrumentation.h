@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "juce_core/juce_core.h"
+
+#if JUCE_INTEL
+    #if JUCE_MSVC
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+// Set to 1 (here or in the Projucer preprocessor definitions) to time each stage of processBlock
+#ifndef PERF_INSTRUMENTATION
+    #define PERF_INSTRUMENTATION 0
+#endif
+
+namespace Perf
+{
+    /**
+     @returns a cheap, monotonic cycle count. Uses the TSC on Intel and falls back to the high resolution
+     clock elsewhere, so only compare cycle counts against each other, never against wall time.
+     */
+    inline juce::uint64 readCycles()
+    {
+#if JUCE_INTEL
+        return __rdtsc();
+#else
+        return static_cast<juce::uint64> (juce::Time::getHighResolutionTicks());
+#endif
+    }
+
+    /** Cycles spent in each stage of the reverb, accumulated over one block */
+    struct StageCycles
+    {
+        juce::uint64 diffuser { 0 };
+        juce::uint64 early { 0 };
+        juce::uint64 feedback { 0 };
+        juce::uint64 mixdown { 0 };
+    };
+
+    /** One entry per processBlock call */
+    struct BlockRecord
+    {
+        StageCycles stages;
+        juce::uint64 blockCycles { 0 };
+        int numSamples { 0 };
+        double blockSeconds { 0.0 };
+        double deadlineSeconds { 0.0 };
+    };
+
+    /** Adds the cycles spent in its scope to a counter */
+    class ScopedCycleCounter
+    {
+    public:
+        explicit ScopedCycleCounter (juce::uint64& counterToAddTo)
+            : counter (counterToAddTo), start (readCycles())
+        {
+        }
+
+        ~ScopedCycleCounter() { counter += readCycles() - start; }
+
+    private:
+        juce::uint64& counter;
+        const juce::uint64 start;
+    };
+
+    /**
+     Lock-free single producer, single consumer FIFO. The audio thread pushes and the message thread pops.
+     If the consumer falls behind, new entries are dropped rather than blocking the producer.
+     */
+    template <typename Item, int capacity>
+    class SpscRing
+    {
+        static_assert ((capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+
+    public:
+        bool push (const Item& item)
+        {
+            const auto write { writeIdx.load (std::memory_order_relaxed) };
+            if (write - readIdx.load (std::memory_order_acquire) == capacity)
+                return false;
+
+            items[write & (capacity - 1)] = item;
+            writeIdx.store (write + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop (Item& item)
+        {
+            const auto read { readIdx.load (std::memory_order_relaxed) };
+            if (read == writeIdx.load (std::memory_order_acquire))
+                return false;
+
+            item = items[read & (capacity - 1)];
+            readIdx.store (read + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::array<Item, capacity> items;
+        std::atomic<juce::uint32> writeIdx { 0 };
+        std::atomic<juce::uint32> readIdx { 0 };
+    };
+
+    using BlockRecordRing = SpscRing<BlockRecord, 1024>;
+}
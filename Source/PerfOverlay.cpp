@@ -0,0 +1,98 @@
+#include "PerfOverlay.h"
+#include "UiHelpers.h"
+
+PerfOverlay::PerfOverlay (Perf::BlockRecordRing& recordsToRead)
+    : records (recordsToRead)
+{
+    dumpButton.onClick = [this] {
+        chooser = std::make_unique<juce::FileChooser> ("Save timing", juce::File::getSpecialLocation (juce::File::userDesktopDirectory).getChildFile ("TheVerbTiming.json"), "*.json");
+        chooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles, [this] (const juce::FileChooser& fc) {
+            if (fc.getResult() != juce::File())
+                dumpToJson (fc.getResult());
+        });
+    };
+
+    addAndMakeVisible (dumpButton);
+    startTimerHz (10);
+}
+
+void PerfOverlay::timerCallback()
+{
+    Perf::BlockRecord record;
+    while (records.pop (record))
+    {
+        history[historyWriteIdx] = record;
+        historyWriteIdx = (historyWriteIdx + 1) % historySize;
+        historyCount = juce::jmin (historyCount + 1, historySize);
+    }
+
+    repaint();
+}
+
+void PerfOverlay::paint (juce::Graphics& g)
+{
+    g.fillAll (juce::Colours::black.withAlpha (0.6f));
+
+    if (historyCount == 0)
+        return;
+
+    double totalLoad { 0.0 };
+    double peakLoad { 0.0 };
+    Perf::StageCycles stages;
+    juce::uint64 blockCycles { 0 };
+
+    for (auto i = 0; i < historyCount; ++i)
+    {
+        const auto& record { history[i] };
+        const auto load { record.deadlineSeconds > 0.0 ? record.blockSeconds / record.deadlineSeconds : 0.0 };
+        totalLoad += load;
+        peakLoad = juce::jmax (peakLoad, load);
+        stages.diffuser += record.stages.diffuser;
+        stages.early += record.stages.early;
+        stages.feedback += record.stages.feedback;
+        stages.mixdown += record.stages.mixdown;
+        blockCycles += record.blockCycles;
+    }
+
+    const auto percentOfBlock = [blockCycles] (juce::uint64 cycles) {
+        return blockCycles > 0 ? 100.0 * static_cast<double> (cycles) / static_cast<double> (blockCycles) : 0.0;
+    };
+
+    auto b { getLocalBounds().reduced (4) };
+    b.removeFromRight (dumpButton.getWidth());
+
+    g.setColour (Colors::hexKnobLightGray);
+    g.setFont (12.0f);
+    g.drawText (juce::String::formatted ("load %.1f%% avg  %.1f%% peak", 100.0 * totalLoad / historyCount, 100.0 * peakLoad), b.removeFromTop (b.getHeight() / 2), juce::Justification::centredLeft);
+    g.drawText (juce::String::formatted ("diff %.0f%% er %.0f%% fb %.0f%% mix %.0f%%", percentOfBlock (stages.diffuser), percentOfBlock (stages.early), percentOfBlock (stages.feedback), percentOfBlock (stages.mixdown)), b, juce::Justification::centredLeft);
+}
+
+void PerfOverlay::resized()
+{
+    dumpButton.setBounds (getLocalBounds().removeFromRight (44).reduced (4));
+}
+
+bool PerfOverlay::dumpToJson (const juce::File& file) const
+{
+    juce::Array<juce::var> blocks;
+
+    // Oldest first
+    const auto firstIdx { historyCount < historySize ? 0 : historyWriteIdx };
+    for (auto i = 0; i < historyCount; ++i)
+    {
+        const auto& record { history[(firstIdx + i) % historySize] };
+
+        auto* block { new juce::DynamicObject() };
+        block->setProperty ("numSamples", record.numSamples);
+        block->setProperty ("blockSeconds", record.blockSeconds);
+        block->setProperty ("deadlineSeconds", record.deadlineSeconds);
+        block->setProperty ("blockCycles", static_cast<juce::int64> (record.blockCycles));
+        block->setProperty ("diffuserCycles", static_cast<juce::int64> (record.stages.diffuser));
+        block->setProperty ("earlyCycles", static_cast<juce::int64> (record.stages.early));
+        block->setProperty ("feedbackCycles", static_cast<juce::int64> (record.stages.feedback));
+        block->setProperty ("mixdownCycles", static_cast<juce::int64> (record.stages.mixdown));
+        blocks.add (juce::var (block));
+    }
+
+    return file.replaceWithText (juce::JSON::toString (juce::var (blocks)));
+}
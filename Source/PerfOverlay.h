@@ -0,0 +1,36 @@
+#pragma once
+
+#include "juce_gui_basics/juce_gui_basics.h"
+
+#include "PerfInstrumentation.h"
+
+/**
+ Small readout of the processor's per-block timing. Drains the processor's BlockRecordRing on a timer,
+ keeps the most recent records, and can dump them to JSON for offline comparison.
+ */
+class PerfOverlay : public juce::Component, private juce::Timer
+{
+public:
+    PerfOverlay (Perf::BlockRecordRing& recordsToRead);
+
+    void paint (juce::Graphics& g) override;
+    void resized() override;
+
+    /// Writes the retained records as a JSON array of objects, one per block
+    bool dumpToJson (const juce::File& file) const;
+
+private:
+    void timerCallback() override;
+
+    Perf::BlockRecordRing& records;
+
+    static constexpr int historySize { 512 };
+    std::array<Perf::BlockRecord, historySize> history;
+    int historyWriteIdx { 0 };
+    int historyCount { 0 };
+
+    juce::TextButton dumpButton { "JSON" };
+    std::unique_ptr<juce::FileChooser> chooser;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerfOverlay)
+};
@@ -18,6 +18,11 @@ TheVerbAudioProcessorEditor::TheVerbAudioProcessorEditor (TheVerbAudioProcessor&
     addAndMakeVisible (roomSize);
     addAndMakeVisible (decay);
     addAndMakeVisible (lpCutoff);
+    addAndMakeVisible (early);
+    addAndMakeVisible (freeze);
+#if PERF_INSTRUMENTATION
+    addAndMakeVisible (perfOverlay);
+#endif
 
     dryAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (audioProcessor.apvts, Params::dryId, dry.getSlider());
     wetAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (audioProcessor.apvts, Params::wetId, wet.getSlider());
@@ -27,6 +32,18 @@ TheVerbAudioProcessorEditor::TheVerbAudioProcessorEditor (TheVerbAudioProcessor&
     modFreqMultAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (audioProcessor.apvts, Params::modFreqId, modFreqMult.getKnob());
 #endif
     lpCutoffAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (audioProcessor.apvts, Params::lpCutoffId, lpCutoff.getSlider());
+    earlyAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (audioProcessor.apvts, Params::earlyId, early.getSlider());
+
+    freeze.setColour (juce::ToggleButton::textColourId, Colors::hexKnobLightGray);
+    freeze.setColour (juce::ToggleButton::tickColourId, Colors::hexKnobLightGray);
+    freeze.setColour (juce::ToggleButton::tickDisabledColourId, Colors::hexKnobLightGray);
+    freezeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment> (audioProcessor.apvts, Params::freezeId, freeze);
+
+    memory.setColour (juce::Label::textColourId, Colors::hexKnobLightGray);
+    memory.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (memory);
+    timerCallback();
+    startTimerHz (2);
 }
 
 TheVerbAudioProcessorEditor::~TheVerbAudioProcessorEditor()
@@ -50,19 +67,45 @@ void TheVerbAudioProcessorEditor::paint (juce::Graphics& g)
     b.removeFromTop (25.0f);
 }
 
+void TheVerbAudioProcessorEditor::timerCallback()
+{
+    const auto report { audioProcessor.getMemoryReport() };
+    const auto toMb = [] (size_t bytes) { return juce::String (static_cast<double> (bytes) / (1024.0 * 1024.0), 1); };
+
+    auto text { "MEM " + toMb (report.usage.getTotal()) };
+    if (report.budget > 0)
+        text << " / " << toMb (report.budget);
+    text << " MB";
+
+    if (! report.withinBudget)
+        text << " OVER";
+
+    memory.setColour (juce::Label::textColourId, report.withinBudget ? Colors::hexKnobLightGray : Colors::warningOrange);
+    memory.setText (text, juce::dontSendNotification);
+}
+
 void TheVerbAudioProcessorEditor::resized()
 {
     auto b { getLocalBounds() };
     const auto margin { 25 };
     const auto knobSize { 200 };
 
+#if PERF_INSTRUMENTATION
+    perfOverlay.setBounds (getLocalBounds().removeFromTop (40).removeFromLeft (220));
+#endif
+
     // Margins
     b.removeFromTop (margin);
     b.removeFromBottom (margin);
     b.removeFromLeft (margin);
     b.removeFromRight (margin);
 
-    logo->setBounds (b.removeFromTop (logoSize));
+    auto logoRow { b.removeFromTop (logoSize) };
+    // Freeze and the memory readout share the right of the logo row, leaving the top left to the perf overlay
+    auto statusColumn { logoRow.removeFromRight (140) };
+    freeze.setBounds (statusColumn.removeFromTop (statusColumn.getHeight() / 2));
+    memory.setBounds (statusColumn);
+    logo->setBounds (logoRow);
 
     b.removeFromTop (margin);
 
@@ -74,11 +117,10 @@ void TheVerbAudioProcessorEditor::resized()
     lpCutoff.setBounds (reverbControlsRow.removeFromLeft (knobSize));
 
     b.removeFromTop (margin);
-    const auto wetDrySideMargin { 112 };
-    auto wetDryRow { b.removeFromTop (knobSize) };
-    wetDryRow.removeFromLeft (wetDrySideMargin);
-    wetDryRow.removeFromRight (wetDrySideMargin);
-    dry.setBounds (wetDryRow.removeFromLeft (knobSize));
-    wetDryRow.removeFromLeft (margin);
-    wet.setBounds (wetDryRow.removeFromLeft (knobSize));
+    auto levelsRow { b.removeFromTop (knobSize) };
+    early.setBounds (levelsRow.removeFromLeft (knobSize));
+    levelsRow.removeFromLeft (margin);
+    dry.setBounds (levelsRow.removeFromLeft (knobSize));
+    levelsRow.removeFromLeft (margin);
+    wet.setBounds (levelsRow.removeFromLeft (knobSize));
 }
@@ -2,6 +2,7 @@
 
 #include "juce_gui_basics/juce_gui_basics.h"
 
+#include "PerfOverlay.h"
 #include "PluginProcessor.h"
 #include "TheVerbKnob.h"
 #include "UiHelpers.h"
@@ -9,7 +10,7 @@
 //==============================================================================
 /**
 */
-class TheVerbAudioProcessorEditor : public juce::AudioProcessorEditor
+class TheVerbAudioProcessorEditor : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     TheVerbAudioProcessorEditor (TheVerbAudioProcessor&);
@@ -20,10 +21,9 @@ public:
     void resized() override;
 
 private:
-    TheVerbAudioProcessor& audioProcessor;
+    void timerCallback() override;
 
-    // LnF
-    HexKnobLnf knobLnf;
+    TheVerbAudioProcessor& audioProcessor;
 
     // Slider
     HexKnob wet { "WET" };
@@ -31,22 +31,35 @@ private:
     HexKnob roomSize { "SIZE" };
     HexKnob decay { "DECAY" };
     HexKnob lpCutoff { "DAMPING" };
+    HexKnob early { "EARLY" };
 
 #if USE_MODULATION
     HexKnob modFreqMult { "MODULATION" };
 #endif
 
+    juce::ToggleButton freeze { "FREEZE" };
+
+    /// The processor's memory use, against its budget if it has one. Polled, as the processor only changes it when preparing.
+    juce::Label memory;
+
     // Slider Attachments
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> wetAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> dryAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> roomSizeAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> decayAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> lpCutoffAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> earlyAttachment;
 
 #if USE_MODULATION
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> modFreqMultAttachment;
 #endif
 
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> freezeAttachment;
+
+#if PERF_INSTRUMENTATION
+    PerfOverlay perfOverlay { audioProcessor.getBlockRecords() };
+#endif
+
     std::unique_ptr<juce::Drawable> logo { juce::Drawable::createFromImageData (BinaryData::logo_svg, BinaryData::logo_svgSize) };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TheVerbAudioProcessorEditor)
@@ -20,11 +20,21 @@ TheVerbAudioProcessor::TheVerbAudioProcessor()
                           .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
     #endif
             ),
-      apvts (*this, nullptr, "ReverbState", createParameterLayout()),
-      reverbL (35, 3),
-      reverbR (35, 3)
+      apvts (*this, nullptr, "ReverbState", createParameterLayout())
 #endif
 {
+    // Looking these up by ID means hashing a string, so do it once here rather than on every block
+    dryParam = apvts.getRawParameterValue (Params::dryId);
+    wetParam = apvts.getRawParameterValue (Params::wetId);
+    roomSizeParam = apvts.getRawParameterValue (Params::roomSizeId);
+    decayParam = apvts.getRawParameterValue (Params::decayId);
+    lpCutoffParam = apvts.getRawParameterValue (Params::lpCutoffId);
+    earlyParam = apvts.getRawParameterValue (Params::earlyId);
+    freezeParam = apvts.getRawParameterValue (Params::freezeId);
+#if DELAY_MOD
+    modFreqParam = apvts.getRawParameterValue (Params::modFreqId);
+    modAmpParam = apvts.getRawParameterValue (Params::modAmpId);
+#endif
 }
 
 TheVerbAudioProcessor::~TheVerbAudioProcessor()
@@ -94,17 +104,106 @@ void TheVerbAudioProcessor::changeProgramName (int index, const juce::String& ne
 }
 
 //==============================================================================
+namespace
+{
+    /// Allocates and configures the left and right reverb of an engine, or frees them if it isn't wanted
+    template <typename ReverbType>
+    void prepareEngine (std::array<std::unique_ptr<ReverbType>, 2>& reverbs, bool shouldAllocate, float sampleRate)
+    {
+        for (size_t channel = 0; channel < reverbs.size(); ++channel)
+        {
+            auto& reverb { reverbs[channel] };
+            if (! shouldAllocate)
+            {
+                reverb = nullptr;
+                continue;
+            }
+
+            if (reverb == nullptr)
+                reverb = std::make_unique<ReverbType> (35, 3);
+
+            reverb->configure (sampleRate, static_cast<int> (channel));
+            reverb->setWet (0.75f);
+            reverb->setDry (0.25f);
+        }
+    }
+}
+
+template <typename Fn>
+void TheVerbAudioProcessor::withEngine (Engine engine, int channel, Fn&& fn)
+{
+    switch (engine)
+    {
+        case Engine::live:
+            fn (*liveReverbs[static_cast<size_t> (channel)]);
+            break;
+        case Engine::render:
+            fn (*renderReverbs[static_cast<size_t> (channel)]);
+            break;
+        case Engine::compact:
+            fn (*compactReverbs[static_cast<size_t> (channel)]);
+            break;
+    }
+}
+
+template <typename Fn>
+void TheVerbAudioProcessor::forEachReverb (Fn&& fn)
+{
+    const auto visit = [&fn] (auto& reverbs) {
+        for (size_t channel = 0; channel < reverbs.size(); ++channel)
+            if (reverbs[channel] != nullptr)
+                fn (*reverbs[channel], static_cast<int> (channel));
+    };
+
+    visit (liveReverbs);
+    visit (renderReverbs);
+    visit (compactReverbs);
+}
+
 void TheVerbAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
-    reverbL.configure (sampleRate);
-    reverbL.setWet (0.75f);
-    reverbL.setDry (0.25f);
-
-    reverbR.configure (sampleRate);
-    reverbR.setWet (0.75f);
-    reverbR.setDry (0.25f);
+    // Work out which engines fit the memory budget before allocating any of them. Engines outside the plan
+    // aren't allocated, and are freed if an earlier prepare made them. Those in it are always ready, so
+    // switching between them never allocates.
+    // If even the compact engine is over budget it's still used, as there's nothing smaller, and the editor shows it.
+    const auto rate { static_cast<float> (sampleRate) };
+    const auto budget { memoryBudget.load() };
+    memoryPlan = Engines::makePlan (rate, budget);
+
+    const auto isPlanned = [this] (Engine engine) { return memoryPlan.playback == engine || memoryPlan.bounce == engine; };
+    prepareEngine (liveReverbs, isPlanned (Engine::live), rate);
+    prepareEngine (renderReverbs, isPlanned (Engine::render), rate);
+    prepareEngine (compactReverbs, isPlanned (Engine::compact), rate);
+
+    MemoryReport report;
+    report.budget = budget;
+    report.withinBudget = memoryPlan.withinBudget;
+    forEachReverb ([&report, rate] (auto& reverb, int channel) { report.usage += reverb.getMemoryUsage (rate, channel); });
+    {
+        const juce::SpinLock::ScopedLockType lock (memoryReportLock);
+        memoryReport = report;
+    }
+
+    handoverBuffer.setSize (2, Reverb<>::blockSize);
+    handoverFadeSamples = juce::jmax (1, static_cast<int> (handoverFadeSeconds * sampleRate));
+    handoverSamplesRemaining = 0;
+    activeEngine = isNonRealtime() ? memoryPlan.bounce : memoryPlan.playback;
+
+    smoothedDry.reset (sampleRate, smoothingSeconds);
+    smoothedDry.setCurrentAndTargetValue (dryParam->load());
+    smoothedWet.reset (sampleRate, smoothingSeconds);
+    smoothedWet.setCurrentAndTargetValue (wetParam->load());
+    smoothedRoomSize.reset (sampleRate, smoothingSeconds);
+    smoothedRoomSize.setCurrentAndTargetValue (roomSizeParam->load());
+    smoothedDecay.reset (sampleRate, smoothingSeconds);
+    smoothedDecay.setCurrentAndTargetValue (decayParam->load());
+    smoothedLpCutoff.reset (sampleRate, smoothingSeconds);
+    smoothedLpCutoff.setCurrentAndTargetValue (lpCutoffParam->load());
+    smoothedEarly.reset (sampleRate, smoothingSeconds);
+    smoothedEarly.setCurrentAndTargetValue (earlyParam->load());
+
+    // The smoothers are at their targets, so this just sets the active engine, and reverbParams, to them
+    updateReverbParams (1);
 }
 
 void TheVerbAudioProcessor::releaseResources()
@@ -142,31 +241,13 @@ bool TheVerbAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 void TheVerbAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+#if PERF_INSTRUMENTATION
+    const auto blockStartTicks { juce::Time::getHighResolutionTicks() };
+    const auto blockStartCycles { Perf::readCycles() };
+#endif
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
-    // Update reverb params
-    const auto roomSizeFudge { (*apvts.getRawParameterValue (Params::roomSizeId) / 4.0f) + 75.0f };
-    const auto rt60Fudge { (*apvts.getRawParameterValue (Params::decayId) / 2) + 3 };
-
-    reverbL.setDry (*apvts.getRawParameterValue (Params::dryId));
-    reverbL.setWet (*apvts.getRawParameterValue ((Params::wetId)));
-    reverbL.setRoomSizeMs (roomSizeFudge);
-    reverbL.setRt60 (rt60Fudge);
-    reverbL.setLpCutoff (*apvts.getRawParameterValue (Params::lpCutoffId));
-#if DELAY_MOD
-    reverbL.setDelayModulation (*apvts.getRawParameterValue (Params::modFreqId), *apvts.getRawParameterValue (Params::modAmpId));
-#endif
-
-    reverbR.setDry (*apvts.getRawParameterValue (Params::dryId));
-    reverbR.setWet (*apvts.getRawParameterValue ((Params::wetId)));
-    reverbR.setRoomSizeMs (roomSizeFudge);
-    reverbR.setRt60 (rt60Fudge);
-    reverbR.setLpCutoff (*apvts.getRawParameterValue (Params::lpCutoffId));
-#if DELAY_MOD
-    reverbR.setDelayModulation (*apvts.getRawParameterValue (Params::modFreqId), *apvts.getRawParameterValue (Params::modAmpId));
-#endif
-
     // In case we have more outputs than inputs, this code clears any output
     // channels that didn't contain input data, (because these aren't
     // guaranteed to be empty - they may contain garbage).
@@ -176,29 +257,148 @@ void TheVerbAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    smoothedDry.setTargetValue (dryParam->load());
+    smoothedWet.setTargetValue (wetParam->load());
+    smoothedRoomSize.setTargetValue (roomSizeParam->load());
+    smoothedDecay.setTargetValue (decayParam->load());
+    smoothedLpCutoff.setTargetValue (lpCutoffParam->load());
+    smoothedEarly.setTargetValue (earlyParam->load());
+
+    // Bounces get the denser engine, if it fits the budget. Hosts can change this without preparing again, so check every block.
+    const auto wantedEngine { isNonRealtime() ? memoryPlan.bounce : memoryPlan.playback };
+    if (wantedEngine != activeEngine)
+        switchEngines (wantedEngine);
+
+    // The reverbs ramp in and out of freeze themselves
+    const auto freeze { freezeParam->load() >= 0.5f };
+    forEachReverb ([freeze] (auto& reverb, int) { reverb.setFreeze (freeze); });
+
+    // Whatever the host's buffer size, the reverb always sees fixed size sub-blocks,
+    // and the parameters are updated once per sub-block, to where the smoothers are at its end
+    const auto numSamples { buffer.getNumSamples() };
+    for (auto start = 0; start < numSamples; start += Reverb<>::blockSize)
     {
-        auto* channelData = buffer.getWritePointer (channel);
+        const auto subBlockSize { juce::jmin (Reverb<>::blockSize, numSamples - start) };
+        updateReverbParams (subBlockSize);
 
-        // fill each channel of the reverb, with the sample
-        for (auto sample = 0; sample < buffer.getNumSamples(); ++sample)
+        for (int channel = 0; channel < totalNumInputChannels; ++channel)
         {
-            for (auto reverbChannel = 0; reverbChannel < NUM_CHANNELS; ++reverbChannel)
-                workingArray[reverbChannel] = channelData[sample];
-
-            if (channel == 0)
-                outputArray = reverbL.process (workingArray);
-            else
-                outputArray = reverbR.process (workingArray);
-
-            // Mix down to mono
-            channelData[sample] = 0;
-            for (auto data : outputArray)
-                channelData[sample] += data;
+            auto* channelData = buffer.getWritePointer (channel, start);
+            withEngine (activeEngine, channel, [channelData, subBlockSize] (auto& reverb) { reverb.processBlock (channelData, channelData, subBlockSize); });
+
+            // Add in the tail of the engine being handed over from. With no inputs, processSends gives just what's left in the network.
+            if (handoverSamplesRemaining > 0)
+            {
+                auto* handoverData = handoverBuffer.getWritePointer (channel);
+                withEngine (handoverEngine, channel, [handoverData, subBlockSize] (auto& reverb) { reverb.processSends (nullptr, nullptr, 0, handoverData, subBlockSize); });
+
+                for (auto i = 0; i < subBlockSize; ++i)
+                {
+                    const auto gain { juce::jmin (1.0f, static_cast<float> (handoverSamplesRemaining - i) / handoverFadeSamples) };
+                    channelData[i] += juce::jmax (0.0f, gain) * handoverData[i];
+                }
+            }
+        }
 
-            channelData[sample] = channelData[sample] / 8.0f;
+        if (handoverSamplesRemaining > 0)
+        {
+            handoverSamplesRemaining -= subBlockSize;
+
+            // Start the engine clean next time it's switched to
+            if (handoverSamplesRemaining <= 0)
+            {
+                handoverSamplesRemaining = 0;
+                resetEngine (handoverEngine);
+            }
         }
     }
+
+#if PERF_INSTRUMENTATION
+    Perf::BlockRecord record;
+    // Every engine, as the one handed over from still runs until its tail has played out
+    forEachReverb ([&record] (auto& reverb, int) {
+        const auto stages { reverb.takeStageCycles() };
+        record.stages.diffuser += stages.diffuser;
+        record.stages.early += stages.early;
+        record.stages.feedback += stages.feedback;
+        record.stages.mixdown += stages.mixdown;
+    });
+    record.blockCycles = Perf::readCycles() - blockStartCycles;
+    record.numSamples = buffer.getNumSamples();
+    record.blockSeconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - blockStartTicks);
+    record.deadlineSeconds = buffer.getNumSamples() / getSampleRate();
+    blockRecords.push (record);
+#endif
+}
+
+void TheVerbAudioProcessor::updateReverbParams (int numSamples)
+{
+    // The smoothers run at the sample rate, so a short final sub-block moves them on less than a full one
+    const auto advance = [numSamples] (auto& smoother) {
+        smoother.skip (numSamples - 1);
+        return smoother.getNextValue();
+    };
+
+    reverbParams.dry = advance (smoothedDry);
+    reverbParams.wet = advance (smoothedWet);
+    reverbParams.roomSizeFudge = (advance (smoothedRoomSize) / 4.0f) + 75.0f;
+    reverbParams.rt60Fudge = (advance (smoothedDecay) / 2) + 3;
+    reverbParams.lpCutoff = advance (smoothedLpCutoff);
+    reverbParams.earlyLevel = advance (smoothedEarly);
+
+    // Only the engines that are running follow the parameters, the one being handed over from included so its
+    // tail keeps responding to them. Idle engines are brought up to date when they're switched in.
+    applyReverbParams (activeEngine);
+    if (handoverSamplesRemaining > 0)
+        applyReverbParams (handoverEngine);
+}
+
+void TheVerbAudioProcessor::applyReverbParams (Engine engine)
+{
+    for (auto channel = 0; channel < 2; ++channel)
+        withEngine (engine, channel, [this] (auto& reverb) {
+            reverb.setDry (reverbParams.dry);
+            reverb.setWet (reverbParams.wet);
+            reverb.setRoomSizeMs (reverbParams.roomSizeFudge);
+            reverb.setRt60 (reverbParams.rt60Fudge);
+            reverb.setLpCutoff (reverbParams.lpCutoff);
+            reverb.setEarlyLevel (reverbParams.earlyLevel);
+#if DELAY_MOD
+            reverb.setDelayModulation (modFreqParam->load(), modAmpParam->load());
+#endif
+        });
+}
+
+void TheVerbAudioProcessor::switchEngines (Engine newEngine)
+{
+    // The engines can't share state, having different networks, so instead the old one plays out its tail
+    // for as long as it takes to decay by 60dB, up to maxHandoverSeconds
+    auto tailSamples { 0 };
+    for (auto channel = 0; channel < 2; ++channel)
+        withEngine (activeEngine, channel, [&tailSamples] (auto& reverb) {
+            const auto samples { reverb.getTailSamples (-60.0f) };
+            tailSamples = samples < 0 || tailSamples < 0 ? -1 : juce::jmax (tailSamples, samples);
+        });
+
+    const auto maxSamples { static_cast<int> (maxHandoverSeconds * getSampleRate()) };
+    handoverSamplesRemaining = tailSamples < 0 ? maxSamples : juce::jmin (tailSamples, maxSamples);
+    handoverEngine = activeEngine;
+    activeEngine = newEngine;
+
+    // It hasn't followed the parameters while idle
+    applyReverbParams (activeEngine);
+}
+
+void TheVerbAudioProcessor::resetEngine (Engine engine)
+{
+    for (auto channel = 0; channel < 2; ++channel)
+        withEngine (engine, channel, [] (auto& reverb) { reverb.reset(); });
+}
+
+TheVerbAudioProcessor::MemoryReport TheVerbAudioProcessor::getMemoryReport() const
+{
+    const juce::SpinLock::ScopedLockType lock (memoryReportLock);
+    return memoryReport;
 }
 
 //==============================================================================
@@ -213,17 +413,70 @@ juce::AudioProcessorEditor* TheVerbAudioProcessor::createEditor()
 }
 
 //==============================================================================
+namespace
+{
+    // Binary state layout: magic, version, parameter count, then one (paramID hash, normalised value) pair per parameter
+    static constexpr juce::int32 stateMagic { 0x42525654 }; // "TVRB"
+    static constexpr juce::int32 stateVersion { 1 };
+    static constexpr int stateHeaderSize { 3 * sizeof (juce::int32) };
+}
+
 void TheVerbAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    juce::MemoryOutputStream stream (destData, false);
+    stream.writeInt (stateMagic);
+    stream.writeInt (stateVersion);
+
+    const auto& params { getParameters() };
+    stream.writeInt (params.size());
+
+    for (auto* param : params)
+    {
+        const auto* ranged { dynamic_cast<juce::RangedAudioParameter*> (param) };
+        stream.writeInt (ranged != nullptr ? ranged->paramID.hashCode() : 0);
+        stream.writeFloat (param->getValue());
+    }
 }
 
 void TheVerbAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    juce::MemoryInputStream stream (data, static_cast<size_t> (sizeInBytes), false);
+
+    if (sizeInBytes >= stateHeaderSize && stream.readInt() == stateMagic)
+    {
+        // Newer versions may append data, but the parameter block must stay readable
+        if (stream.readInt() < 1)
+            return;
+
+        // Read every saved value first, so matching them to parameters is a lookup rather than a search
+        std::unordered_map<int, float> savedValues;
+        const auto numParams { stream.readInt() };
+        for (auto i = 0; i < numParams && stream.getNumBytesRemaining() >= 8; ++i)
+        {
+            const auto idHash { stream.readInt() };
+            savedValues[idHash] = juce::jlimit (0.0f, 1.0f, stream.readFloat());
+        }
+
+        // Restore through a single replaceState, like the fallback below, so the host only hears about the
+        // parameters that actually change rather than one notification per parameter per instance
+        auto newState { apvts.copyState() };
+        for (auto child : newState)
+        {
+            const auto paramID { child.getProperty ("id").toString() };
+            const auto saved { savedValues.find (paramID.hashCode()) };
+            const auto* param { apvts.getParameter (paramID) };
+            if (saved != savedValues.end() && param != nullptr)
+                child.setProperty ("value", param->convertFrom0to1 (saved->second), nullptr);
+        }
+
+        apvts.replaceState (newState);
+        return;
+    }
+
+    // Fall back to a binary ValueTree, as written by apvts.copyState().writeToStream()
+    const auto tree { juce::ValueTree::readFromData (data, static_cast<size_t> (sizeInBytes)) };
+    if (tree.hasType (apvts.state.getType()))
+        apvts.replaceState (tree);
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout TheVerbAudioProcessor::createParameterLayout()
@@ -251,6 +504,12 @@ juce::AudioProcessorValueTreeState::ParameterLayout TheVerbAudioProcessor::creat
     auto lpCutoff = std::make_unique<juce::AudioParameterFloat> (Params::lpCutoffId, "Cutoff Frequency", 100.f, 18000.0f, 6000.0f);
     params.push_back (std::move (lpCutoff));
 
+    auto early = std::make_unique<juce::AudioParameterFloat> (Params::earlyId, "Early Reflections", 0.f, 1.0f, 0.0f);
+    params.push_back (std::move (early));
+
+    auto freeze = std::make_unique<juce::AudioParameterBool> (Params::freezeId, "Freeze", false);
+    params.push_back (std::move (freeze));
+
     return { params.begin(), params.end() };
 }
 
@@ -1,7 +1,7 @@
 
 #pragma once
 
-#include "DspComponents.h"
+#include "ReverbEngines.h"
 #include "juce_audio_processors/juce_audio_processors.h"
 
 #undef USE_MODULATION
@@ -16,6 +16,8 @@ namespace Params
     static constexpr auto* modFreqId { "modulationFreq" };
     static constexpr auto* modAmpId { "modulationAmp" };
     static constexpr auto* lpCutoffId { "lpCutoff" };
+    static constexpr auto* freezeId { "freeze" };
+    static constexpr auto* earlyId { "early" };
 }
 
 //==============================================================================
@@ -68,12 +70,110 @@ public:
 
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
+#if PERF_INSTRUMENTATION
+    /// Timing for each processBlock call, consumed by the editor's PerfOverlay
+    Perf::BlockRecordRing& getBlockRecords() { return blockRecords; }
+#endif
+
+    /// What the allocated engines use, by stage, and whether that fits the memory budget. Updated by prepareToPlay.
+    struct MemoryReport
+    {
+        ReverbMemoryUsage usage;
+        size_t budget { Engines::defaultMemoryBudget };
+        bool withinBudget { true };
+    };
+
+    MemoryReport getMemoryReport() const;
+
+    /**
+     Caps what the reverb engines allocate, in bytes, with 0 for no limit. Takes effect at the next
+     prepareToPlay. Starts at MEMORY_BUDGET_KB.
+     */
+    void setMemoryBudget (size_t bytes) { memoryBudget = bytes; }
+
 private:
     //==============================================================================
-    Reverb<> reverbL;
-    Reverb<> reverbR;
-    std::array<float, NUM_CHANNELS> workingArray;
-    std::array<float, NUM_CHANNELS> outputArray;
+    /// Moves the smoothers on by a sub-block of numSamples and applies their values to the engines that are running
+    void updateReverbParams (int numSamples);
+
+    using Engine = Engines::Engine;
+
+    /// Sets an engine's reverbs to the parameters updateReverbParams last worked out
+    void applyReverbParams (Engine engine);
+
+    /// Starts feeding another engine, leaving the one that was in use to play out its tail
+    void switchEngines (Engine newEngine);
+
+    /// Clears an engine, so it starts from silence next time it's used
+    void resetEngine (Engine engine);
+
+    /// Calls fn with the left or right reverb of an engine, which must be allocated
+    template <typename Fn>
+    void withEngine (Engine engine, int channel, Fn&& fn);
+
+    /// Calls fn with every reverb that's allocated
+    template <typename Fn>
+    void forEachReverb (Fn&& fn);
+
+    // Left and right reverb of each engine. Only the engines in the memory plan are allocated.
+    std::array<std::unique_ptr<Engines::Live>, 2> liveReverbs;
+    std::array<std::unique_ptr<Engines::Render>, 2> renderReverbs;
+    std::array<std::unique_ptr<Engines::Compact>, 2> compactReverbs;
+
+    std::atomic<size_t> memoryBudget { Engines::defaultMemoryBudget };
+    Engines::Plan memoryPlan;
+
+    /// The engine being fed: memoryPlan's playback engine, or its bounce engine while the host is bouncing
+    Engine activeEngine { Engine::live };
+
+    MemoryReport memoryReport;
+    mutable juce::SpinLock memoryReportLock;
+
+    // After a switch, the engine that was in use keeps running on silence so its tail plays out under the
+    // new engine's instead of being cut off. Long tails are faded out over the end of maxHandoverSeconds.
+    static constexpr double maxHandoverSeconds { 4.0 };
+    static constexpr double handoverFadeSeconds { 0.5 };
+    Engine handoverEngine { Engine::render };
+    int handoverSamplesRemaining { 0 };
+    int handoverFadeSamples { 1 };
+    juce::AudioBuffer<float> handoverBuffer;
+
+    /// The smoothed parameters as of the last sub-block, as the reverbs take them
+    struct ReverbParams
+    {
+        float dry { 0.0f };
+        float wet { 1.0f };
+        float roomSizeFudge { 0.0f };
+        float rt60Fudge { 0.0f };
+        float lpCutoff { 0.0f };
+        float earlyLevel { 0.0f };
+    };
+
+    ReverbParams reverbParams;
+
+    static constexpr double smoothingSeconds { 0.05 };
+    juce::SmoothedValue<float> smoothedDry;
+    juce::SmoothedValue<float> smoothedWet;
+    juce::SmoothedValue<float> smoothedRoomSize;
+    juce::SmoothedValue<float> smoothedDecay;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> smoothedLpCutoff;
+    juce::SmoothedValue<float> smoothedEarly;
+
+    std::atomic<float>* dryParam { nullptr };
+    std::atomic<float>* wetParam { nullptr };
+    std::atomic<float>* roomSizeParam { nullptr };
+    std::atomic<float>* decayParam { nullptr };
+    std::atomic<float>* lpCutoffParam { nullptr };
+    std::atomic<float>* freezeParam { nullptr };
+    std::atomic<float>* earlyParam { nullptr };
+#if DELAY_MOD
+    std::atomic<float>* modFreqParam { nullptr };
+    std::atomic<float>* modAmpParam { nullptr };
+#endif
+
+#if PERF_INSTRUMENTATION
+    Perf::BlockRecordRing blockRecords;
+#endif
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TheVerbAudioProcessor)
 };
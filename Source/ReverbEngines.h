@@ -0,0 +1,92 @@
+#pragma once
+
+#include "DspComponents.h"
+
+// Default memory budget for one plugin instance, in KB. 0 means no limit. Hosts can set their own at runtime.
+#ifndef MEMORY_BUDGET_KB
+    #define MEMORY_BUDGET_KB 0
+#endif
+
+/**
+ The reverb engines TheVerbAudioProcessor can run, and how it picks which of them to allocate under a
+ memory budget. Kept apart from the processor so TheVerbRender can report the same numbers.
+ */
+namespace Engines
+{
+    /// For live playback
+    using Live = Reverb<>;
+
+    /// For bounces: twice the channels and two more diffusion steps, for a denser tail at around three times the CPU
+    using Render = Reverb<2 * NUM_CHANNELS, DIFF_STEPS + 2>;
+
+    /// Stands in for both when the budget won't stretch to Live: half the channels
+    using Compact = Reverb<NUM_CHANNELS / 2>;
+
+    enum class Engine
+    {
+        compact,
+        live,
+        render
+    };
+
+    static constexpr size_t defaultMemoryBudget { MEMORY_BUDGET_KB * size_t { 1024 } };
+
+    /// Which engines a stereo instance allocates, and what they come to
+    struct Plan
+    {
+        Engine playback { Engine::live };
+        Engine bounce { Engine::render };
+        size_t bytes { 0 };
+        bool withinBudget { true };
+    };
+
+    /**
+     @returns what a left and right pair of ReverbType allocate at the sample rate, on variants 0 and 1.
+     Diffusion times follow the room size and, within the plugin's range, never exceed a fresh Reverb's,
+     so this is an upper bound.
+     */
+    template <typename ReverbType>
+    ReverbMemoryUsage getStereoUsage (float sampleRate)
+    {
+        const ReverbType reverb (35, 3);
+        auto usage { reverb.getMemoryUsage (sampleRate, 0) };
+        usage += reverb.getMemoryUsage (sampleRate, 1);
+        return usage;
+    }
+
+    /**
+     @returns the richest set of engines that fits the budget: Live with Render for bounces, then Live for
+     both, then Compact for both. Compact is used even if it doesn't fit, as there's nothing smaller.
+     @param budget in bytes, 0 for no limit
+     */
+    inline Plan makePlan (float sampleRate, size_t budget)
+    {
+        const auto liveUsage { getStereoUsage<Live> (sampleRate) };
+        const auto liveBytes { liveUsage.getTotal() };
+
+        // Added as usages rather than totals, so the kernel both engines share is counted once
+        auto bothUsage { liveUsage };
+        bothUsage += getStereoUsage<Render> (sampleRate);
+        const auto bothBytes { bothUsage.getTotal() };
+
+        Plan plan;
+        if (budget == 0 || bothBytes <= budget)
+        {
+            plan.bytes = bothBytes;
+        }
+        else if (liveBytes <= budget)
+        {
+            plan.bounce = Engine::live;
+            plan.bytes = liveBytes;
+        }
+        else
+        {
+            plan.playback = Engine::compact;
+            plan.bounce = Engine::compact;
+            plan.bytes = getStereoUsage<Compact> (sampleRate).getTotal();
+            plan.withinBudget = plan.bytes <= budget;
+        }
+
+        return plan;
+    }
+}
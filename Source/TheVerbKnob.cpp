@@ -58,7 +58,7 @@ void HexKnobLnf::drawRotarySlider (juce::Graphics& g, int x, int y, int width, i
 
 HexKnob::HexKnob (juce::StringRef name)
 {
-    knob.setLookAndFeel (&lnf);
+    knob.setLookAndFeel (&lnf.get());
     // set the start and end angles to the right values
     knob.setRotaryParameters ({ 0.0, 4.18879, true });
 
@@ -70,6 +70,11 @@ HexKnob::HexKnob (juce::StringRef name)
     addAndMakeVisible (label);
 }
 
+HexKnob::~HexKnob()
+{
+    knob.setLookAndFeel (nullptr);
+}
+
 void HexKnob::resized()
 {
     auto b { getLocalBounds() };
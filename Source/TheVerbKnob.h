@@ -22,13 +22,15 @@ class HexKnob : public juce::Component
 {
 public:
     HexKnob (juce::StringRef name);
+    ~HexKnob() override;
 
     void resized() override;
     /// So the SliderAttachments can attach to the slider
     juce::Slider& getSlider() { return knob; }
 
 private:
+    /// One look and feel, and one copy of its drawables, shared by every knob in the process
+    juce::SharedResourcePointer<HexKnobLnf> lnf;
     juce::Slider knob { juce::Slider::SliderStyle::RotaryVerticalDrag, juce::Slider::TextEntryBoxPosition::NoTextBox };
     juce::Label label;
-    HexKnobLnf lnf;
 };
@@ -0,0 +1,103 @@
+#include "TraceEvents.h"
+
+namespace Trace
+{
+    Recorder& Recorder::getInstance()
+    {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    Recorder::Recorder()
+        : originTicks (juce::Time::getHighResolutionTicks())
+    {
+    }
+
+    Recorder::ThreadBuffer& Recorder::getBufferForThisThread()
+    {
+        // Owned by the recorder so the spans outlive the thread that made them
+        thread_local ThreadBuffer* buffer { nullptr };
+
+        if (buffer == nullptr)
+        {
+            auto newBuffer { std::make_unique<ThreadBuffer>() };
+            newBuffer->threadName = juce::Thread::getCurrentThread() != nullptr ? juce::Thread::getCurrentThread()->getThreadName() : juce::String ("main");
+            newBuffer->spans.reserve (4096);
+
+            const std::lock_guard<std::mutex> lock (buffersMutex);
+            newBuffer->threadIdx = static_cast<int> (buffers.size()) + 1;
+            buffer = newBuffer.get();
+            buffers.push_back (std::move (newBuffer));
+        }
+
+        return *buffer;
+    }
+
+    void Recorder::addSpan (const char* name, juce::int64 startTicks, juce::int64 endTicks)
+    {
+        auto& buffer { getBufferForThisThread() };
+        if (buffer.spans.size() < maxSpansPerThread)
+        {
+            buffer.spans.push_back ({ name, startTicks, endTicks });
+        }
+        else
+        {
+            if (buffer.numDropped == 0)
+                buffer.firstDroppedTicks = startTicks;
+
+            ++buffer.numDropped;
+        }
+    }
+
+    size_t Recorder::getNumDroppedSpans() const
+    {
+        const std::lock_guard<std::mutex> lock (buffersMutex);
+
+        size_t numDropped { 0 };
+        for (const auto& buffer : buffers)
+            numDropped += buffer->numDropped;
+
+        return numDropped;
+    }
+
+    bool Recorder::writeJson (const juce::File& file) const
+    {
+        file.deleteFile();
+        juce::FileOutputStream out (file);
+        if (out.failedToOpen())
+            return false;
+
+        const auto ticksToMicros = [this] (juce::int64 ticks) {
+            return juce::Time::highResolutionTicksToSeconds (ticks - originTicks) * 1.0e6;
+        };
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        const std::lock_guard<std::mutex> lock (buffersMutex);
+        auto isFirst { true };
+        for (const auto& buffer : buffers)
+        {
+            out << (isFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIdx
+                << ",\"args\":{\"name\":" << buffer->threadName.quoted() << "}}";
+            isFirst = false;
+
+            for (const auto& span : buffer->spans)
+            {
+                out << ",\n{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadIdx
+                    << ",\"ts\":" << juce::String (ticksToMicros (span.startTicks), 3)
+                    << ",\"dur\":" << juce::String (ticksToMicros (span.endTicks) - ticksToMicros (span.startTicks), 3) << "}";
+            }
+
+            if (buffer->numDropped > 0)
+            {
+                out << ",\n{\"name\":\"truncated\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << buffer->threadIdx
+                    << ",\"ts\":" << juce::String (ticksToMicros (buffer->firstDroppedTicks), 3)
+                    << ",\"args\":{\"droppedSpans\":" << juce::String (static_cast<juce::int64> (buffer->numDropped)) << "}}";
+            }
+        }
+
+        out << "\n]}\n";
+        out.flush();
+        return out.getStatus().wasOk();
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "juce_core/juce_core.h"
+
+// Set to 1 (here or in the Projucer preprocessor definitions) to compile in the trace spans
+#ifndef TRACE_EVENTS
+    #define TRACE_EVENTS 0
+#endif
+
+namespace Trace
+{
+    /**
+     Collects timed spans from any number of threads and writes them out as Chrome trace-event JSON,
+     which loads straight into Perfetto (ui.perfetto.dev) or chrome://tracing.
+
+     Each thread appends to its own buffer, so recording never takes a lock after a thread's first span.
+     Spans are only recorded while the recorder is enabled.
+     */
+    class Recorder
+    {
+    public:
+        static Recorder& getInstance();
+
+        void setEnabled (bool shouldBeEnabled) { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+        bool isEnabled() const { return enabled.load (std::memory_order_relaxed); }
+
+        /// @param name must outlive the recorder, i.e. be a string literal
+        void addSpan (const char* name, juce::int64 startTicks, juce::int64 endTicks);
+
+        /**
+         Writes every span recorded so far. Call this once the traced threads have finished. A thread that hit
+         its span cap gets a "truncated" instant event where its spans stop, naming how many were dropped.
+         */
+        bool writeJson (const juce::File& file) const;
+
+        /// How many spans have been dropped, across all threads, because a thread reached its cap
+        size_t getNumDroppedSpans() const;
+
+    private:
+        Recorder();
+
+        struct Span
+        {
+            const char* name;
+            juce::int64 startTicks;
+            juce::int64 endTicks;
+        };
+
+        struct ThreadBuffer
+        {
+            int threadIdx;
+            juce::String threadName;
+            std::vector<Span> spans;
+            size_t numDropped { 0 };
+            juce::int64 firstDroppedTicks { 0 };
+        };
+
+        ThreadBuffer& getBufferForThisThread();
+
+        // Caps memory use at 6 MB per thread, around a minute of spans for one render thread at 48 kHz
+        static constexpr size_t maxSpansPerThread { 1 << 18 };
+
+        std::atomic<bool> enabled { false };
+        const juce::int64 originTicks;
+
+        mutable std::mutex buffersMutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    /** Records a span covering its own lifetime */
+    class ScopedSpan
+    {
+    public:
+        explicit ScopedSpan (const char* spanName)
+            : name (spanName), startTicks (Recorder::getInstance().isEnabled() ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedSpan()
+        {
+            if (startTicks != 0)
+                Recorder::getInstance().addSpan (name, startTicks, juce::Time::getHighResolutionTicks());
+        }
+
+    private:
+        const char* name;
+        const juce::int64 startTicks;
+    };
+}
+
+#if TRACE_EVENTS
+    #define TRACE_SCOPE(name) const Trace::ScopedSpan JUCE_JOIN_MACRO (traceSpan, __LINE__) (name)
+#else
+    #define TRACE_SCOPE(name)
+#endif
@@ -7,6 +7,7 @@ namespace Colors
 {
     const auto hexKnobLightGray { juce::Colour (0xff6f6f6f) };
     const auto backgroundTeal { juce::Colour (0xff08303c) };
+    const auto warningOrange { juce::Colour (0xffe0703c) };
 }
 
 namespace Fonts
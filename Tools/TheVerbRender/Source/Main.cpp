@@ -0,0 +1,197 @@
+#include "OfflineRenderer.h"
+#include "ReverbAnalysis.h"
+#include "RenderVerifier.h"
+#include "../../../Source/ReverbEngines.h"
+
+namespace
+{
+    float getFloatOption (const juce::ArgumentList& args, juce::StringRef option, float defaultValue)
+    {
+        return args.containsOption (option) ? args.getValueForOption (option).getFloatValue() : defaultValue;
+    }
+
+    RenderSettings getRenderSettings (const juce::ArgumentList& args)
+    {
+        RenderSettings settings;
+        settings.dry = getFloatOption (args, "--dry", settings.dry);
+        settings.wet = getFloatOption (args, "--wet", settings.wet);
+        settings.roomSize = getFloatOption (args, "--size", settings.roomSize);
+        settings.decay = getFloatOption (args, "--decay", settings.decay);
+        settings.lpCutoff = getFloatOption (args, "--cutoff", settings.lpCutoff);
+        settings.early = getFloatOption (args, "--early", settings.early);
+        return settings;
+    }
+
+    void analyse (const juce::ArgumentList& args)
+    {
+        const ReverbAnalysis analysis (getRenderSettings (args));
+        std::cout << analysis.run (getFloatOption (args, "--rate", 48000.0f));
+    }
+
+    void memory (const juce::ArgumentList& args)
+    {
+        const auto sampleRate { getFloatOption (args, "--rate", 48000.0f) };
+        const auto budget { static_cast<size_t> (getFloatOption (args, "--budget", MEMORY_BUDGET_KB)) * size_t { 1024 } };
+
+        std::cout << "Memory for a left and right reverb at " << sampleRate << " Hz\n";
+        std::cout << "  live     " << ReverbAnalysis::formatMemory (Engines::getStereoUsage<Engines::Live> (sampleRate)) << "\n";
+        std::cout << "  render   " << ReverbAnalysis::formatMemory (Engines::getStereoUsage<Engines::Render> (sampleRate)) << "\n";
+        std::cout << "  compact  " << ReverbAnalysis::formatMemory (Engines::getStereoUsage<Engines::Compact> (sampleRate)) << "\n";
+
+        const auto plan { Engines::makePlan (sampleRate, budget) };
+        const auto engineName = [] (Engines::Engine engine) {
+            return engine == Engines::Engine::live ? "live" : engine == Engines::Engine::render ? "render" : "compact";
+        };
+
+        std::cout << "The plugin would use " << engineName (plan.playback) << " for playback and " << engineName (plan.bounce) << " for bounces, "
+                  << juce::String (static_cast<double> (plan.bytes) / 1024.0, 1) << " KB in all";
+        if (budget > 0)
+            std::cout << " against a budget of " << budget / 1024 << " KB";
+        std::cout << "\n";
+
+        if (! plan.withinBudget)
+            juce::ConsoleApplication::fail ("Even the compact engine doesn't fit the budget");
+    }
+
+    void makeReferences (const juce::ArgumentList& args)
+    {
+        RenderVerifier verifier (args.getFileForOption ("--make-references"));
+        const auto result { verifier.writeReferences() };
+        if (result.failed())
+            juce::ConsoleApplication::fail (result.getErrorMessage());
+    }
+
+    void verify (const juce::ArgumentList& args)
+    {
+        RenderVerifier verifier (args.getExistingFolderForOption ("--verify"));
+        juce::String report;
+        const auto result { verifier.verify (report) };
+        std::cout << report;
+
+        if (result.failed())
+            juce::ConsoleApplication::fail (result.getErrorMessage());
+    }
+
+    void render (const juce::ArgumentList& args)
+    {
+        auto settings { getRenderSettings (args) };
+
+        if (args.containsOption ("--threads"))
+        {
+            const auto numThreads { args.getValueForOption ("--threads").getIntValue() };
+            settings.numThreads = numThreads > 0 ? numThreads : juce::SystemStats::getNumCpus();
+        }
+
+        if (args.containsOption ("--chunk-memory"))
+            settings.maxChunkMemoryBytes = static_cast<size_t> (getFloatOption (args, "--chunk-memory", 0.0f)) << 20;
+
+        const auto traceFile { args.containsOption ("--trace") ? args.getFileForOption ("--trace") : juce::File() };
+        Trace::Recorder::getInstance().setEnabled (traceFile != juce::File());
+
+        OfflineRenderer renderer (settings);
+        juce::Result result { juce::Result::ok() };
+
+        if (args.containsOption ("--sends"))
+        {
+            const auto inputDir { args.getExistingFolderForOption ("--sends") };
+
+            juce::AudioFormatManager formatManager;
+            formatManager.registerBasicFormats();
+            auto files { inputDir.findChildFiles (juce::File::findFiles, false, formatManager.getWildcardForAllFormats()) };
+            files.sort();
+
+            // Levels and pans are comma-separated lists, in the same (alphabetical) order as the files
+            const auto gains { juce::StringArray::fromTokens (args.getValueForOption ("--send-gains"), ",", {}) };
+            const auto pans { juce::StringArray::fromTokens (args.getValueForOption ("--send-pans"), ",", {}) };
+
+            std::vector<OfflineRenderer::Send> sends;
+            for (auto i = 0; i < files.size(); ++i)
+            {
+                OfflineRenderer::Send send;
+                send.file = files[i];
+                if (i < gains.size())
+                    send.gain = juce::Decibels::decibelsToGain (gains[i].getFloatValue());
+                if (i < pans.size())
+                    send.pan = pans[i].getFloatValue();
+
+                sends.push_back (send);
+            }
+
+            result = renderer.renderSends (sends, args.getFileForOption ("--output"));
+        }
+        else if (args.containsOption ("--batch"))
+        {
+            const auto inputDir { args.getExistingFolderForOption ("--batch") };
+            const auto outputDir { args.getExistingFolderForOption ("--output") };
+
+            juce::AudioFormatManager formatManager;
+            formatManager.registerBasicFormats();
+            const auto inputs { inputDir.findChildFiles (juce::File::findFiles, false, formatManager.getWildcardForAllFormats()) };
+            result = renderer.renderBatch (inputs, outputDir);
+        }
+        else
+        {
+            result = renderer.render (args.getExistingFileForOption ("--input"), args.getFileForOption ("--output"));
+        }
+
+        if (traceFile != juce::File())
+        {
+            if (! Trace::Recorder::getInstance().writeJson (traceFile))
+                juce::ConsoleApplication::fail ("Couldn't write " + traceFile.getFullPathName());
+
+            if (const auto numDropped { Trace::Recorder::getInstance().getNumDroppedSpans() }; numDropped > 0)
+                std::cout << "The trace is truncated: " << numDropped << " spans were dropped past the per-thread cap\n";
+        }
+
+        if (result.failed())
+            juce::ConsoleApplication::fail (result.getErrorMessage());
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "TheVerbRender: runs audio files through TheVerb without a host", true);
+    app.addDefaultCommand ({ "",
+        "(--input <file> --output <file.wav> | --batch <input dir> --output <dir> | --sends <input dir> --output <file.wav> [--send-gains <dB,...>] [--send-pans <-1..1,...>]) [--size 25-100] [--decay 0-6] [--dry 0-1] [--wet 0-1] [--cutoff 100-18000] [--early 0-1] [--threads <n, 0 for all cores>] [--chunk-memory <MB>] [--trace <file.json>]",
+        "Renders a file, or every file in a folder, through the reverb",
+        "--batch renders the files side by side through a SIMD engine that runs one reverb per vector lane.\n"
+        "--sends renders the reverb return for every file in a folder feeding one send, through a single reverb.\n"
+        "--threads splits a file into chunks rendered in parallel and overlap-added, matching a serial render.\n"
+        "--chunk-memory caps what the chunks in flight hold, 256 MB by default, by running fewer or shorter ones.\n"
+        "--trace writes Chrome trace-event JSON for the render, which can be opened in Perfetto.",
+        render });
+
+    app.addCommand ({ "--analyse",
+        "--analyse [--rate <Hz>] [--size 25-100] [--decay 0-6] [--cutoff 100-18000] [--early 0-1]",
+        "Compares the quality and cost of the reverb's variants",
+        "Renders an impulse response through each channel count, diffusion step count, diffuser and interpolation variant, and prints\n"
+        "echo density over time, RT60 per octave band, spectral flatness, modal density, level, delay memory and ns/sample for each,\n"
+        "then times the --batch engine against rendering the same files one at a time.",
+        analyse });
+
+    app.addCommand ({ "--memory",
+        "--memory [--rate <Hz>] [--budget <KB>]",
+        "Reports the plugin's memory use by stage, and which engines fit a budget",
+        "Prints what a left and right reverb allocate for each of the plugin's engines at the sample rate, then which of them\n"
+        "the plugin allocates under the budget. --budget defaults to MEMORY_BUDGET_KB, where 0 means no limit.",
+        memory });
+
+    app.addCommand ({ "--make-references",
+        "--make-references <dir>",
+        "Writes the golden renders and summaries that --verify checks against",
+        "Renders fixed stimuli (an impulse, a noise burst, a sine sweep and a long train of bursts) through the serial path,\n"
+        "with a short and a long decay, and summarises each render's levels in summary.txt. Regenerate them whenever the sound\n"
+        "is meant to change, into Tools/TheVerbRender/References from a Release build, and commit summary.txt.",
+        makeReferences });
+
+    app.addCommand ({ "--verify",
+        "--verify <dir>",
+        "Checks every render path against the golden renders",
+        "Renders the stimuli through the serial, SIMD batch, multi-send and parallel chunked paths and compares each with the\n"
+        "references from --make-references: the summaries in dB, and the renders sample by sample if they're in the folder.\n"
+        "Exits with an error if anything is out of tolerance.",
+        verify });
+
+    return app.findAndRunCommand (argc, argv);
+}
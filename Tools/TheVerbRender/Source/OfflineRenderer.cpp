@@ -0,0 +1,468 @@
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer (const RenderSettings& settingsToUse)
+    : settings (settingsToUse)
+{
+    formatManager.registerBasicFormats();
+    readThread.startThread();
+    writeThread.startThread();
+}
+
+template <typename ReverbType>
+void OfflineRenderer::applySettings (ReverbType& reverb) const
+{
+    applyRenderSettings (reverb, settings);
+}
+
+juce::Result OfflineRenderer::render (const juce::File& input, const juce::File& output)
+{
+    const auto reader { openReader (input) };
+    if (reader == nullptr)
+        return juce::Result::fail ("Couldn't read " + input.getFullPathName());
+
+    std::unique_ptr<Writer> writer;
+    if (const auto result { createWriter (output, *reader, writer) }; result.failed())
+        return result;
+
+    if (settings.numThreads > 1 && Reverb<>::isTimeInvariant)
+        return renderChunked (*reader, *writer);
+
+    return renderSerial (*reader, *writer);
+}
+
+juce::Result OfflineRenderer::renderSerial (juce::AudioFormatReader& reader, Writer& writer)
+{
+    const auto numChannels { static_cast<int> (reader.numChannels) };
+
+    std::vector<std::unique_ptr<Reverb<>>> reverbs;
+    for (auto channel = 0; channel < numChannels; ++channel)
+    {
+        reverbs.push_back (std::make_unique<Reverb<>> (35, 3));
+        reverbs.back()->configure (static_cast<float> (reader.sampleRate), channel);
+        applySettings (*reverbs.back());
+    }
+
+    juce::AudioBuffer<float> block (numChannels, settings.blockSize);
+
+    for (juce::int64 position = 0; position < reader.lengthInSamples; position += settings.blockSize)
+    {
+        const auto numSamples { static_cast<int> (juce::jmin<juce::int64> (settings.blockSize, reader.lengthInSamples - position)) };
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::read");
+            if (! reader.read (&block, 0, numSamples, position, true, true))
+                return juce::Result::fail ("Read error");
+        }
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            reverbs[static_cast<size_t> (channel)]->processBlock (block.getReadPointer (channel), block.getWritePointer (channel), numSamples);
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::write");
+            if (! write (writer, block, numSamples))
+                return juce::Result::fail ("Write error");
+        }
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result OfflineRenderer::renderChunked (juce::AudioFormatReader& reader, Writer& writer)
+{
+    // With nothing modulated the reverb is linear and time-invariant, so rendering each chunk from silence
+    // and overlap-adding the chunks' tails gives the same output as one long serial render, give or take
+    // whatever is left of a tail after it has decayed by tailThresholdDb
+    static constexpr float tailThresholdDb { -120.0f };
+
+    const auto numChannels { static_cast<int> (reader.numChannels) };
+    const auto sampleRate { static_cast<float> (reader.sampleRate) };
+
+    const auto makeReverb = [this, sampleRate] (int channel) {
+        auto reverb { std::make_unique<Reverb<>> (35, 3) };
+        reverb->configure (sampleRate, channel);
+        applySettings (*reverb);
+        return reverb;
+    };
+
+    // Every chunk has to use the same taps. Holding a reverb per channel keeps their tables in the cache
+    // for the whole render, so each chunk's reverbs share them rather than generating new ones.
+    std::vector<std::unique_ptr<Reverb<>>> tableHolders;
+    for (auto channel = 0; channel < numChannels; ++channel)
+        tableHolders.push_back (makeReverb (channel));
+
+    const auto tailSamples { tableHolders.front()->getTailSamples (tailThresholdDb) };
+    if (tailSamples < 0)
+        return renderSerial (reader, writer);
+
+    // Each chunk in flight holds its samples and tail, plus a reverb while it renders, and the carry holds one
+    // more tail. Run as many chunks at once as the memory budget allows, then make them as long as it allows,
+    // up to minChunkSeconds. Each chunk's tail must only reach into the next chunk.
+    const auto bytesPerSample { static_cast<size_t> (numChannels) * sizeof (float) };
+    // A chunk's reverb shares its tables and interpolation kernel with the holders, so only its own delay lines count
+    const auto reverbUsage { tableHolders.front()->getMemoryUsage (sampleRate, 0) };
+    const auto reverbBytes { reverbUsage.getTotal() - reverbUsage.tables - reverbUsage.kernels };
+    const auto carryBytes { static_cast<size_t> (tailSamples) * bytesPerSample };
+    const auto shortestChunkSamples { 4 * tailSamples };
+    const auto getChunkBytes = [&] (juce::int64 numSamples) { return static_cast<size_t> (numSamples + tailSamples) * bytesPerSample + reverbBytes; };
+
+    if (carryBytes + 2 * getChunkBytes (shortestChunkSamples) > settings.maxChunkMemoryBytes)
+        return renderSerial (reader, writer);
+
+    const auto bytesForChunks { settings.maxChunkMemoryBytes - carryBytes };
+    const auto numThreads { static_cast<int> (juce::jmin<size_t> (static_cast<size_t> (settings.numThreads), bytesForChunks / getChunkBytes (shortestChunkSamples))) };
+    if (numThreads < 2)
+        return renderSerial (reader, writer);
+
+    const auto longestChunkSamples { static_cast<int> (juce::jmin<size_t> ((bytesForChunks / static_cast<size_t> (numThreads) - reverbBytes) / bytesPerSample - static_cast<size_t> (tailSamples),
+                                                                            std::numeric_limits<int>::max())) };
+    const auto chunkSamples { juce::jlimit (shortestChunkSamples, longestChunkSamples, static_cast<int> (settings.minChunkSeconds * sampleRate)) };
+
+    struct Chunk
+    {
+        juce::int64 start { 0 };
+        int numSamples { 0 };
+        juce::AudioBuffer<float> buffer;
+    };
+
+    juce::ThreadPool pool (numThreads);
+    std::vector<Chunk> chunks (static_cast<size_t> (numThreads));
+    for (auto& chunk : chunks)
+        chunk.buffer.setSize (numChannels, chunkSamples + tailSamples);
+
+    // Tail of the previous chunk that still has to be added to the next one
+    juce::AudioBuffer<float> carry (numChannels, tailSamples);
+    carry.clear();
+
+    for (juce::int64 waveStart = 0; waveStart < reader.lengthInSamples; waveStart += static_cast<juce::int64> (chunkSamples) * numThreads)
+    {
+        int numChunksInWave { 0 };
+        for (auto& chunk : chunks)
+        {
+            chunk.start = waveStart + static_cast<juce::int64> (chunkSamples) * numChunksInWave;
+            if (chunk.start >= reader.lengthInSamples)
+                break;
+
+            chunk.numSamples = static_cast<int> (juce::jmin<juce::int64> (chunkSamples, reader.lengthInSamples - chunk.start));
+            chunk.buffer.clear();
+
+            TRACE_SCOPE ("OfflineRenderer::read");
+            if (! reader.read (&chunk.buffer, 0, chunk.numSamples, chunk.start, true, true))
+                return juce::Result::fail ("Read error");
+
+            ++numChunksInWave;
+        }
+
+        juce::WaitableEvent waveFinished;
+        std::atomic<int> chunksRemaining { numChunksInWave };
+        for (auto i = 0; i < numChunksInWave; ++i)
+        {
+            pool.addJob ([&, i] {
+                auto& chunk { chunks[static_cast<size_t> (i)] };
+                const auto numToRender { chunk.numSamples + tailSamples };
+
+                for (auto channel = 0; channel < numChannels; ++channel)
+                    makeReverb (channel)->processBlock (chunk.buffer.getReadPointer (channel), chunk.buffer.getWritePointer (channel), numToRender);
+
+                if (--chunksRemaining == 0)
+                    waveFinished.signal();
+            });
+        }
+
+        waveFinished.wait();
+
+        TRACE_SCOPE ("OfflineRenderer::write");
+        for (auto i = 0; i < numChunksInWave; ++i)
+        {
+            auto& chunk { chunks[static_cast<size_t> (i)] };
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+            {
+                chunk.buffer.addFrom (channel, 0, carry, channel, 0, tailSamples);
+                carry.copyFrom (channel, 0, chunk.buffer, channel, chunk.numSamples, tailSamples);
+            }
+
+            if (! write (writer, chunk.buffer, chunk.numSamples))
+                return juce::Result::fail ("Write error");
+        }
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result OfflineRenderer::renderBatch (const juce::Array<juce::File>& inputs, const juce::File& outputDir)
+{
+    struct Job
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        std::unique_ptr<Writer> writer;
+        juce::AudioBuffer<float> block;
+    };
+
+    std::vector<Job> jobs;
+    for (const auto& input : inputs)
+    {
+        Job job;
+        job.reader = openReader (input);
+        if (job.reader == nullptr)
+            return juce::Result::fail ("Couldn't read " + input.getFullPathName());
+
+        if (! jobs.empty() && job.reader->sampleRate != jobs.front().reader->sampleRate)
+            return juce::Result::fail (input.getFullPathName() + " doesn't have the same sample rate as the rest of the batch");
+
+        if (const auto result { createWriter (outputDir.getChildFile (input.getFileNameWithoutExtension() + ".wav"), *job.reader, job.writer) }; result.failed())
+            return result;
+
+        job.block.setSize (static_cast<int> (job.reader->numChannels), settings.blockSize);
+        jobs.push_back (std::move (job));
+    }
+
+    if (jobs.empty())
+        return juce::Result::ok();
+
+    // Channel n of every file goes through a lane of an engine configured with variant n, so each lane
+    // sounds exactly like the matching channel of a single file render
+    struct LaneSlot
+    {
+        size_t jobIdx;
+        int channel;
+    };
+
+    std::vector<std::unique_ptr<BatchReverb>> engines;
+    std::vector<std::array<LaneSlot, interleavedNativeLanes>> engineSlots;
+    std::vector<int> engineNumLanes;
+
+    juce::int64 longestInput { 0 };
+    int maxChannels { 0 };
+    for (const auto& job : jobs)
+    {
+        longestInput = juce::jmax (longestInput, job.reader->lengthInSamples);
+        maxChannels = juce::jmax (maxChannels, static_cast<int> (job.reader->numChannels));
+    }
+
+    for (auto channel = 0; channel < maxChannels; ++channel)
+    {
+        for (size_t jobIdx = 0; jobIdx < jobs.size(); ++jobIdx)
+        {
+            if (channel >= static_cast<int> (jobs[jobIdx].reader->numChannels))
+                continue;
+
+            if (engines.empty() || engineNumLanes.back() == interleavedNativeLanes || engineSlots.back()[0].channel != channel)
+            {
+                engines.push_back (std::make_unique<BatchReverb>());
+                engines.back()->configure (static_cast<float> (jobs.front().reader->sampleRate), channel);
+                applySettings (*engines.back());
+                engineSlots.emplace_back();
+                engineNumLanes.push_back (0);
+            }
+
+            engineSlots.back()[static_cast<size_t> (engineNumLanes.back()++)] = { jobIdx, channel };
+        }
+    }
+
+    // Lanes without a file still need somewhere to read and write
+    juce::AudioBuffer<float> spareLanes (interleavedNativeLanes, settings.blockSize);
+
+    for (juce::int64 position = 0; position < longestInput; position += settings.blockSize)
+    {
+        const auto numSamples { static_cast<int> (juce::jmin<juce::int64> (settings.blockSize, longestInput - position)) };
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::read");
+            for (auto& job : jobs)
+            {
+                // Reading past the end fills with zeros, which lets the shorter files keep step with the rest
+                if (! job.reader->read (&job.block, 0, numSamples, position, true, true))
+                    return juce::Result::fail ("Read error");
+            }
+        }
+
+        spareLanes.clear();
+        for (size_t engineIdx = 0; engineIdx < engines.size(); ++engineIdx)
+        {
+            std::array<float*, interleavedNativeLanes> lanes;
+            for (auto lane = 0; lane < interleavedNativeLanes; ++lane)
+            {
+                const auto& slot { engineSlots[engineIdx][static_cast<size_t> (lane)] };
+                lanes[static_cast<size_t> (lane)] = lane < engineNumLanes[engineIdx] ? jobs[slot.jobIdx].block.getWritePointer (slot.channel)
+                                                                                        : spareLanes.getWritePointer (lane);
+            }
+
+            engines[engineIdx]->processBlock (lanes.data(), lanes.data(), numSamples);
+        }
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::write");
+            for (auto& job : jobs)
+            {
+                const auto numToWrite { static_cast<int> (juce::jlimit<juce::int64> (0, numSamples, job.reader->lengthInSamples - position)) };
+                if (numToWrite > 0 && ! write (*job.writer, job.block, numToWrite))
+                    return juce::Result::fail ("Write error");
+            }
+        }
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result OfflineRenderer::renderSends (const std::vector<Send>& sends, const juce::File& output)
+{
+    struct Input
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        juce::AudioBuffer<float> block;
+        Reverb<>::InjectionGains injectionGains;
+    };
+
+    std::vector<Input> inputs;
+    juce::int64 longestInput { 0 };
+    int numChannels { 0 };
+    int bitsPerSample { 16 };
+
+    for (const auto& send : sends)
+    {
+        Input input;
+        input.reader = openReader (send.file);
+        if (input.reader == nullptr)
+            return juce::Result::fail ("Couldn't read " + send.file.getFullPathName());
+
+        if (! inputs.empty() && input.reader->sampleRate != inputs.front().reader->sampleRate)
+            return juce::Result::fail (send.file.getFullPathName() + " doesn't have the same sample rate as the other sends");
+
+        input.block.setSize (static_cast<int> (input.reader->numChannels), settings.blockSize);
+        input.injectionGains = Reverb<>::makeInjectionGains (send.gain, send.pan);
+
+        longestInput = juce::jmax (longestInput, input.reader->lengthInSamples);
+        numChannels = juce::jmax (numChannels, static_cast<int> (input.reader->numChannels));
+        bitsPerSample = juce::jmax (bitsPerSample, static_cast<int> (input.reader->bitsPerSample));
+        inputs.push_back (std::move (input));
+    }
+
+    if (inputs.empty())
+        return juce::Result::ok();
+
+    const auto sampleRate { inputs.front().reader->sampleRate };
+
+    std::unique_ptr<Writer> writer;
+    if (const auto result { createWriter (output, sampleRate, numChannels, bitsPerSample, writer) }; result.failed())
+        return result;
+
+    // One reverb per output channel, however many inputs there are
+    std::vector<std::unique_ptr<Reverb<>>> reverbs;
+    for (auto channel = 0; channel < numChannels; ++channel)
+    {
+        reverbs.push_back (std::make_unique<Reverb<>> (35, 3));
+        reverbs.back()->configure (static_cast<float> (sampleRate), channel);
+        applySettings (*reverbs.back());
+    }
+
+    std::vector<const float*> inputPointers (inputs.size());
+    std::vector<Reverb<>::InjectionGains> injectionGains;
+    for (const auto& input : inputs)
+        injectionGains.push_back (input.injectionGains);
+
+    juce::AudioBuffer<float> block (numChannels, settings.blockSize);
+
+    for (juce::int64 position = 0; position < longestInput; position += settings.blockSize)
+    {
+        const auto numSamples { static_cast<int> (juce::jmin<juce::int64> (settings.blockSize, longestInput - position)) };
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::read");
+            for (auto& input : inputs)
+            {
+                // Reading past the end fills with zeros, so shorter inputs just stop feeding the send
+                if (! input.reader->read (&input.block, 0, numSamples, position, true, true))
+                    return juce::Result::fail ("Read error");
+            }
+        }
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            for (size_t i = 0; i < inputs.size(); ++i)
+            {
+                const auto& inputBlock { inputs[i].block };
+                inputPointers[i] = inputBlock.getReadPointer (juce::jmin (channel, inputBlock.getNumChannels() - 1));
+            }
+
+            reverbs[static_cast<size_t> (channel)]->processSends (inputPointers.data(), injectionGains.data(), static_cast<int> (inputs.size()), block.getWritePointer (channel), numSamples);
+        }
+
+        {
+            TRACE_SCOPE ("OfflineRenderer::write");
+            if (! write (*writer, block, numSamples))
+                return juce::Result::fail ("Write error");
+        }
+    }
+
+    return juce::Result::ok();
+}
+
+std::unique_ptr<juce::AudioFormatReader> OfflineRenderer::openReader (const juce::File& input)
+{
+    std::unique_ptr<juce::AudioFormatReader> source;
+
+    // Memory-map where the format allows it, so the OS pages the file in as it's read
+    if (auto* format { formatManager.findFormatForFileExtension (input.getFileExtension()) })
+    {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader (input));
+        if (mapped != nullptr && mapped->mapEntireFile())
+            source = std::move (mapped);
+    }
+
+    if (source == nullptr)
+        source.reset (formatManager.createReaderFor (input));
+
+    if (source == nullptr)
+        return nullptr;
+
+    // Reads ahead on the reader thread, so page faults and disk waits happen there rather than in the DSP
+    auto buffered { std::make_unique<juce::BufferingAudioReader> (source.release(), readThread, ioBufferSamples()) };
+    buffered->setReadTimeout (-1);
+    return buffered;
+}
+
+juce::Result OfflineRenderer::createWriter (const juce::File& output, const juce::AudioFormatReader& reader, std::unique_ptr<Writer>& writer)
+{
+    return createWriter (output, reader.sampleRate, static_cast<int> (reader.numChannels), static_cast<int> (reader.bitsPerSample), writer);
+}
+
+juce::Result OfflineRenderer::createWriter (const juce::File& output, double sampleRate, int numChannels, int bitsPerSample, std::unique_ptr<Writer>& writer)
+{
+    output.deleteFile();
+    auto outStream { std::make_unique<juce::FileOutputStream> (output) };
+    if (outStream->failedToOpen())
+        return juce::Result::fail ("Couldn't open " + output.getFullPathName());
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> fileWriter (wav.createWriterFor (outStream.get(), sampleRate, static_cast<unsigned int> (numChannels), bitsPerSample, {}, 0));
+    if (fileWriter == nullptr)
+        return juce::Result::fail ("Couldn't create a WAV writer for " + output.getFullPathName());
+
+    // The writer owns the stream now, and the threaded writer owns the writer
+    outStream.release();
+    writer = std::make_unique<Writer> (fileWriter.release(), writeThread, ioBufferSamples());
+    return juce::Result::ok();
+}
+
+bool OfflineRenderer::write (Writer& writer, const juce::AudioBuffer<float>& buffer, int numSamples) const
+{
+    // The writer only accepts blocks that fit in its FIFO, so hand over at most one block at a time
+    std::vector<const float*> channels (static_cast<size_t> (buffer.getNumChannels()));
+
+    for (auto start = 0; start < numSamples; start += settings.blockSize)
+    {
+        const auto numToWrite { juce::jmin (settings.blockSize, numSamples - start) };
+        for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+            channels[static_cast<size_t> (channel)] = buffer.getReadPointer (channel, start);
+
+        while (! writer.write (channels.data(), numToWrite))
+        {
+            if (! writeThread.isThreadRunning())
+                return false;
+
+            juce::Thread::sleep (1);
+        }
+    }
+
+    return true;
+}
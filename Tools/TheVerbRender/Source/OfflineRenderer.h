@@ -0,0 +1,112 @@
+#pragma once
+
+#include "juce_audio_formats/juce_audio_formats.h"
+
+#include "../../../Source/DspComponents.h"
+#include "../../../Source/InterleavedReverb.h"
+
+/** Parameter values for a render, with the same ranges and defaults as the plugin's parameters */
+struct RenderSettings
+{
+    float dry { 0.0f };
+    float wet { 1.0f };
+    float roomSize { 95.0f };
+    float decay { 6.0f };
+    float lpCutoff { 6000.0f };
+    float early { 0.0f };
+
+    int blockSize { 4096 };
+
+    /// More than one splits the file into chunks rendered in parallel, if the reverb is time-invariant
+    int numThreads { 1 };
+
+    /// Shortest chunk for parallel renders, if maxChunkMemoryBytes allows. Chunks are always at least four times the reverb's tail.
+    double minChunkSeconds { 30.0 };
+
+    /**
+     Most that the chunks of a parallel render, and the reverbs rendering them, may hold at once. Fewer threads
+     or shorter chunks are used to stay under it, and the render is serial if not even two chunks fit.
+     */
+    size_t maxChunkMemoryBytes { size_t { 256 } << 20 };
+};
+
+/** Sets a reverb's parameters with the same mapping as TheVerbAudioProcessor::processBlock, so renders match the plugin */
+template <typename ReverbType>
+void applyRenderSettings (ReverbType& reverb, const RenderSettings& settings)
+{
+    reverb.setDry (settings.dry);
+    reverb.setWet (settings.wet);
+    reverb.setRoomSizeMs ((settings.roomSize / 4.0f) + 75.0f);
+    reverb.setRt60 ((settings.decay / 2) + 3);
+    reverb.setLpCutoff (settings.lpCutoff);
+    reverb.setEarlyLevel (settings.early);
+}
+
+/**
+ Headless version of TheVerbAudioProcessor: runs an audio file through one Reverb per channel and writes
+ the result as a WAV file.
+
+ Files are streamed rather than loaded, so memory use doesn't depend on their length. Inputs are
+ memory-mapped where the format allows and read ahead on one thread, output is written on another, and the
+ calling thread only ever processes.
+ */
+class OfflineRenderer
+{
+public:
+    explicit OfflineRenderer (const RenderSettings& settingsToUse);
+
+    juce::Result render (const juce::File& input, const juce::File& output);
+
+    /**
+     Renders every file in a batch with the same settings, writing each to outputDir under the same name.
+     Files are packed into the lanes of an InterleavedReverb, so one pass of the network serves several files.
+     All the inputs must have the same sample rate.
+     */
+    juce::Result renderBatch (const juce::Array<juce::File>& inputs, const juce::File& outputDir);
+
+    /// Level and pan of one input to renderSends
+    struct Send
+    {
+        juce::File file;
+        float gain { 1.0f };
+        float pan { 0.0f };
+    };
+
+    /**
+     Renders the reverb return for several inputs sharing one send, e.g. the stems of a mix. Channel n of the
+     output is one reverb fed with channel n of every input (or its only channel, for mono inputs) at that
+     input's level, so the cost barely grows with the number of inputs. The output is wet only and has as many
+     channels as the widest input. All the inputs must have the same sample rate.
+     */
+    juce::Result renderSends (const std::vector<Send>& sends, const juce::File& output);
+
+private:
+    using BatchReverb = InterleavedReverb<interleavedNativeLanes>;
+
+    template <typename ReverbType>
+    void applySettings (ReverbType& reverb) const;
+
+    using Writer = juce::AudioFormatWriter::ThreadedWriter;
+
+    juce::Result renderSerial (juce::AudioFormatReader& reader, Writer& writer);
+    juce::Result renderChunked (juce::AudioFormatReader& reader, Writer& writer);
+
+    /// @returns a reader that reads ahead on readThread, or nullptr if the file can't be read
+    std::unique_ptr<juce::AudioFormatReader> openReader (const juce::File& input);
+    juce::Result createWriter (const juce::File& output, const juce::AudioFormatReader& reader, std::unique_ptr<Writer>& writer);
+    juce::Result createWriter (const juce::File& output, double sampleRate, int numChannels, int bitsPerSample, std::unique_ptr<Writer>& writer);
+
+    /// Hands a block to the writer thread, waiting for room in its FIFO if need be
+    bool write (Writer& writer, const juce::AudioBuffer<float>& buffer, int numSamples) const;
+
+    RenderSettings settings;
+    juce::AudioFormatManager formatManager;
+
+    // Enough to keep the DSP busy while the disk catches up, but independent of the file length
+    int ioBufferSamples() const { return 16 * settings.blockSize; }
+
+    juce::TimeSliceThread readThread { "TheVerbRender reader" };
+    juce::TimeSliceThread writeThread { "TheVerbRender writer" };
+
+    JUCE_DECLARE_NON_COPYABLE (OfflineRenderer)
+};
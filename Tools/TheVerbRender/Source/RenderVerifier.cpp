@@ -0,0 +1,467 @@
+#include "RenderVerifier.h"
+
+namespace
+{
+    struct Path
+    {
+        const char* name;
+        float tolerance;
+    };
+
+    // Largest sample difference from the reference renders. Compilers differ in which multiplies and adds they
+    // fuse and how they vectorise sums, so even a serial render from another build only matches to within
+    // rounding. The chunked path also drops whatever is left of each chunk's tail below -120dB.
+    static constexpr std::array<Path, 4> paths { {
+        { "serial", 1.0e-5f },
+        { "batch", 1.0e-5f },
+        { "sends", 1.0e-5f },
+        { "chunked", 2.0e-5f },
+    } };
+
+    // Summaries are compared in dB, loosely enough for rounding differences between builds but tightly enough
+    // to catch a change to the sound. The quietest windows are skipped, as whether a build flushes denormals
+    // can change them.
+    static constexpr float rmsToleranceDb { 0.05f };
+    static constexpr float peakToleranceDb { 0.1f };
+    static constexpr float envelopeToleranceDb { 0.1f };
+    static constexpr float envelopeFloorDb { -90.0f };
+
+    static constexpr juce::uint64 fnvOffset { 0xcbf29ce484222325 };
+    static constexpr juce::uint64 fnvPrime { 0x100000001b3 };
+
+    struct Setting
+    {
+        const char* name;
+        float roomSize;
+        float decay;
+    };
+
+    // The short tail, about a second, lets the long stimulus span several chunks. The long one takes tens of
+    // seconds to decay, so every stimulus is checked while the network is still recirculating, and the
+    // chunked path has to carry tails across its chunk boundaries.
+    static constexpr std::array<Setting, 2> settings { {
+        { "short", 25.0f, 0.0f },
+        { "long", 100.0f, 6.0f },
+    } };
+
+    static constexpr int numStimulusChannels { 2 };
+    static constexpr juce::int64 stimulusSeed { 1234 };
+
+    juce::File createTempDir()
+    {
+        auto dir { juce::File::getSpecialLocation (juce::File::tempDirectory).getNonexistentChildFile ("TheVerbVerify", {}) };
+        dir.createDirectory();
+        return dir;
+    }
+}
+
+RenderVerifier::RenderVerifier (const juce::File& referenceDirToUse)
+    : referenceDir (referenceDirToUse)
+{
+    formatManager.registerBasicFormats();
+}
+
+RenderSettings RenderVerifier::getSettings (float roomSize, float decay)
+{
+    RenderSettings renderSettings;
+    renderSettings.roomSize = roomSize;
+    renderSettings.decay = decay;
+    renderSettings.early = 0.5f;
+    renderSettings.minChunkSeconds = 0.0;
+    return renderSettings;
+}
+
+juce::StringArray RenderVerifier::getStimulusNames()
+{
+    return { "impulse", "noise", "sweep", "bursts" };
+}
+
+juce::AudioBuffer<float> RenderVerifier::makeStimulus (const juce::String& name)
+{
+    // Each stimulus is followed by silence, so the references include the tail
+    const auto seconds { name == "bursts" ? 200.0 : 4.0 };
+    juce::AudioBuffer<float> buffer (numStimulusChannels, static_cast<int> (seconds * sampleRate));
+    buffer.clear();
+
+    juce::Random random { stimulusSeed };
+    const auto addNoise = [&buffer, &random] (double startSeconds, double lengthSeconds) {
+        const auto start { static_cast<int> (startSeconds * sampleRate) };
+        const auto length { static_cast<int> (lengthSeconds * sampleRate) };
+        for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (auto i = start; i < start + length; ++i)
+                buffer.setSample (channel, i, 0.5f * (random.nextFloat() * 2.0f - 1.0f));
+    };
+
+    if (name == "impulse")
+    {
+        for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+            buffer.setSample (channel, 0, 1.0f);
+    }
+    else if (name == "noise")
+    {
+        addNoise (0.0, 0.5);
+    }
+    else if (name == "sweep")
+    {
+        // Exponential sweep from 20Hz to 20kHz over 2 seconds
+        static constexpr double startHz { 20.0 };
+        static constexpr double endHz { 20000.0 };
+        static constexpr double sweepSeconds { 2.0 };
+        const auto rate { std::log (endHz / startHz) };
+
+        for (auto i = 0; i < static_cast<int> (sweepSeconds * sampleRate); ++i)
+        {
+            const auto t { i / sampleRate };
+            const auto phase { juce::MathConstants<double>::twoPi * startHz * sweepSeconds / rate * (std::exp (t / sweepSeconds * rate) - 1.0) };
+            for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.setSample (channel, i, 0.5f * static_cast<float> (std::sin (phase)));
+        }
+    }
+    else if (name == "bursts")
+    {
+        // Starting just before each 10 seconds, so some bursts straddle the chunk boundaries of a parallel render
+        for (auto start = 9.9; start < seconds - 10.0; start += 10.0)
+            addNoise (start, 0.2);
+    }
+
+    return buffer;
+}
+
+juce::Result RenderVerifier::writeStimuli (const juce::File& dir) const
+{
+    juce::WavAudioFormat wav;
+    for (const auto& name : getStimulusNames())
+    {
+        const auto stimulus { makeStimulus (name) };
+        const auto file { dir.getChildFile (name + ".wav") };
+        file.deleteFile();
+
+        auto stream { std::make_unique<juce::FileOutputStream> (file) };
+        if (stream->failedToOpen())
+            return juce::Result::fail ("Couldn't open " + file.getFullPathName());
+
+        // 32 bit, so the stimuli are stored as floats and don't pick up any dither or rounding
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (stream.get(), sampleRate, numStimulusChannels, 32, {}, 0));
+        if (writer == nullptr)
+            return juce::Result::fail ("Couldn't create a WAV writer for " + file.getFullPathName());
+
+        stream.release();
+        if (! writer->writeFromAudioSampleBuffer (stimulus, 0, stimulus.getNumSamples()))
+            return juce::Result::fail ("Couldn't write " + file.getFullPathName());
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result RenderVerifier::renderPath (const juce::String& path, const juce::File& stimulusDir, const juce::File& outputDir) const
+{
+    for (const auto& setting : settings)
+    {
+        const auto settingDir { outputDir.getChildFile (setting.name) };
+        if (const auto created { settingDir.createDirectory() }; created.failed())
+            return created;
+
+        auto renderSettings { getSettings (setting.roomSize, setting.decay) };
+        if (path == "chunked")
+            renderSettings.numThreads = 4;
+
+        OfflineRenderer renderer (renderSettings);
+
+        if (path == "batch")
+        {
+            juce::Array<juce::File> inputs;
+            for (const auto& name : getStimulusNames())
+                inputs.add (stimulusDir.getChildFile (name + ".wav"));
+
+            if (const auto result { renderer.renderBatch (inputs, settingDir) }; result.failed())
+                return result;
+
+            continue;
+        }
+
+        for (const auto& name : getStimulusNames())
+        {
+            const auto input { stimulusDir.getChildFile (name + ".wav") };
+            const auto output { settingDir.getChildFile (name + ".wav") };
+
+            // A single centred send at unity gain should sound just like a plain render
+            const auto result { path == "sends" ? renderer.renderSends ({ { input, 1.0f, 0.0f } }, output)
+                                                : renderer.render (input, output) };
+            if (result.failed())
+                return result;
+        }
+    }
+
+    return juce::Result::ok();
+}
+
+juce::Result RenderVerifier::writeReferences()
+{
+    const auto created { referenceDir.createDirectory() };
+    if (created.failed())
+        return created;
+
+    const auto stimulusDir { createTempDir() };
+    auto result { writeStimuli (stimulusDir) };
+    if (result.wasOk())
+        result = renderPath ("serial", stimulusDir, referenceDir);
+    if (result.wasOk())
+        result = writeSummaries (referenceDir);
+
+    stimulusDir.deleteRecursively();
+    return result;
+}
+
+juce::Result RenderVerifier::verify (juce::String& report)
+{
+    const auto summaries { readSummaries() };
+    const auto haveReferenceRenders { referenceDir.getChildFile (settings.front().name).getChildFile (getStimulusNames()[0] + ".wav").existsAsFile() };
+    if (summaries.empty() && ! haveReferenceRenders)
+        return juce::Result::fail ("There are no references in " + referenceDir.getFullPathName());
+
+    const auto stimulusDir { createTempDir() };
+    const auto outputDir { createTempDir() };
+
+    auto result { writeStimuli (stimulusDir) };
+    auto numFailures { 0 };
+
+    for (const auto& path : paths)
+    {
+        if (result.failed())
+            break;
+
+        result = renderPath (path.name, stimulusDir, outputDir);
+
+        for (const auto& setting : settings)
+        {
+            for (const auto& name : getStimulusNames())
+            {
+                if (result.failed())
+                    break;
+
+                const auto renderName { juce::String (setting.name) + "/" + name };
+                const auto file { outputDir.getChildFile (setting.name).getChildFile (name + ".wav") };
+                juce::StringArray notes;
+                auto passed { true };
+
+                if (const auto reference { summaries.find (renderName) }; reference != summaries.end())
+                {
+                    const auto summary { summarise (file) };
+                    const auto mismatch { compareSummaries (summary, reference->second) };
+                    passed = mismatch.isEmpty();
+
+                    const auto isBitIdentical { passed && std::equal (summary.begin(), summary.end(), reference->second.begin(), [] (const auto& a, const auto& b) { return a.hash == b.hash; }) };
+                    notes.add (passed ? (isBitIdentical ? "summary bit-identical" : "summary within tolerance") : mismatch);
+                }
+                else if (! summaries.empty())
+                {
+                    passed = false;
+                    notes.add ("no summary to check against");
+                }
+
+                if (haveReferenceRenders)
+                {
+                    const auto maxDifference { getMaxDifference (file, referenceDir.getChildFile (setting.name).getChildFile (name + ".wav")) };
+                    if (maxDifference < 0.0f || maxDifference > path.tolerance)
+                        passed = false;
+
+                    notes.add ((maxDifference < 0.0f ? juce::String ("render missing or mismatched") : "max difference " + juce::String (maxDifference))
+                               + " (tolerance " + juce::String (path.tolerance) + ")");
+                }
+
+                if (! passed)
+                    ++numFailures;
+
+                report << juce::String (path.name).paddedRight (' ', 9) << renderName.paddedRight (' ', 15) << notes.joinIntoString (", ") << " " << (passed ? "ok" : "FAILED") << "\n";
+            }
+        }
+    }
+
+    stimulusDir.deleteRecursively();
+    outputDir.deleteRecursively();
+
+    if (result.wasOk() && numFailures > 0)
+        return juce::Result::fail (juce::String (numFailures) + " renders didn't match their references");
+
+    return result;
+}
+
+float RenderVerifier::getMaxDifference (const juce::File& file, const juce::File& reference)
+{
+    std::unique_ptr<juce::AudioFormatReader> fileReader (formatManager.createReaderFor (file));
+    std::unique_ptr<juce::AudioFormatReader> referenceReader (formatManager.createReaderFor (reference));
+
+    if (fileReader == nullptr || referenceReader == nullptr
+        || fileReader->numChannels != referenceReader->numChannels
+        || fileReader->lengthInSamples != referenceReader->lengthInSamples)
+        return -1.0f;
+
+    const auto numChannels { static_cast<int> (fileReader->numChannels) };
+    static constexpr int blockSize { 65536 };
+    juce::AudioBuffer<float> fileBlock (numChannels, blockSize);
+    juce::AudioBuffer<float> referenceBlock (numChannels, blockSize);
+
+    auto maxDifference { 0.0f };
+    for (juce::int64 position = 0; position < fileReader->lengthInSamples; position += blockSize)
+    {
+        const auto numSamples { static_cast<int> (juce::jmin<juce::int64> (blockSize, fileReader->lengthInSamples - position)) };
+        fileReader->read (&fileBlock, 0, numSamples, position, true, true);
+        referenceReader->read (&referenceBlock, 0, numSamples, position, true, true);
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            const auto* a { fileBlock.getReadPointer (channel) };
+            const auto* b { referenceBlock.getReadPointer (channel) };
+            for (auto i = 0; i < numSamples; ++i)
+                maxDifference = juce::jmax (maxDifference, std::abs (a[i] - b[i]));
+        }
+    }
+
+    return maxDifference;
+}
+
+RenderVerifier::Summary RenderVerifier::summarise (const juce::File& file)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+    if (reader == nullptr)
+        return {};
+
+    const auto numChannels { static_cast<int> (reader->numChannels) };
+    const auto windowSamples { static_cast<int> (envelopeWindowSeconds * reader->sampleRate) };
+    const auto toDb = [] (double gain) { return juce::Decibels::gainToDecibels (static_cast<float> (gain), minLevelDb); };
+
+    Summary summary (static_cast<size_t> (numChannels));
+    std::vector<double> sumSquares (static_cast<size_t> (numChannels), 0.0);
+    std::vector<float> peaks (static_cast<size_t> (numChannels), 0.0f);
+    std::vector<juce::uint64> hashes (static_cast<size_t> (numChannels), fnvOffset);
+
+    juce::AudioBuffer<float> block (numChannels, windowSamples);
+    for (juce::int64 position = 0; position < reader->lengthInSamples; position += windowSamples)
+    {
+        const auto numSamples { static_cast<int> (juce::jmin<juce::int64> (windowSamples, reader->lengthInSamples - position)) };
+        reader->read (&block, 0, numSamples, position, true, true);
+
+        for (size_t channel = 0; channel < summary.size(); ++channel)
+        {
+            const auto* samples { block.getReadPointer (static_cast<int> (channel)) };
+            auto windowSumSquares { 0.0 };
+            for (auto i = 0; i < numSamples; ++i)
+            {
+                windowSumSquares += static_cast<double> (samples[i]) * samples[i];
+                peaks[channel] = juce::jmax (peaks[channel], std::abs (samples[i]));
+
+                juce::uint32 bits;
+                std::memcpy (&bits, samples + i, sizeof (bits));
+                hashes[channel] = (hashes[channel] ^ bits) * fnvPrime;
+            }
+
+            sumSquares[channel] += windowSumSquares;
+            summary[channel].envelopeDb.push_back (toDb (std::sqrt (windowSumSquares / numSamples)));
+        }
+    }
+
+    for (size_t channel = 0; channel < summary.size(); ++channel)
+    {
+        summary[channel].hash = juce::String::toHexString (static_cast<juce::int64> (hashes[channel])).paddedLeft ('0', 16);
+        summary[channel].rmsDb = toDb (std::sqrt (sumSquares[channel] / static_cast<double> (juce::jmax<juce::int64> (1, reader->lengthInSamples))));
+        summary[channel].peakDb = toDb (peaks[channel]);
+    }
+
+    return summary;
+}
+
+juce::Result RenderVerifier::writeSummaries (const juce::File& dir)
+{
+    juce::String text;
+    text << "# Written by TheVerbRender --make-references. One line per setting, stimulus and channel:\n";
+    text << "# setting/stimulus, channel, sample hash, RMS dB, peak dB, then the RMS dB of each " << envelopeWindowSeconds << " s\n";
+
+    for (const auto& setting : settings)
+    {
+        for (const auto& name : getStimulusNames())
+        {
+            const auto renderName { juce::String (setting.name) + "/" + name };
+            const auto summary { summarise (dir.getChildFile (setting.name).getChildFile (name + ".wav")) };
+            if (summary.empty())
+                return juce::Result::fail ("Couldn't read the render of " + renderName);
+
+            for (size_t channel = 0; channel < summary.size(); ++channel)
+            {
+                const auto& s { summary[channel] };
+                text << renderName << " " << static_cast<int> (channel) << " " << s.hash << " " << juce::String (s.rmsDb, 2) << " " << juce::String (s.peakDb, 2);
+                for (auto level : s.envelopeDb)
+                    text << " " << juce::String (level, 2);
+                text << "\n";
+            }
+        }
+    }
+
+    const auto file { dir.getChildFile (summaryFileName) };
+    if (! file.replaceWithText (text, false, false, "\n"))
+        return juce::Result::fail ("Couldn't write " + file.getFullPathName());
+
+    return juce::Result::ok();
+}
+
+std::map<juce::String, RenderVerifier::Summary> RenderVerifier::readSummaries() const
+{
+    juce::StringArray lines;
+    referenceDir.getChildFile (summaryFileName).readLines (lines);
+
+    std::map<juce::String, Summary> summaries;
+    for (const auto& line : lines)
+    {
+        if (line.trim().isEmpty() || line.startsWith ("#"))
+            continue;
+
+        const auto tokens { juce::StringArray::fromTokens (line, false) };
+        if (tokens.size() < 5)
+            continue;
+
+        auto& summary { summaries[tokens[0]] };
+        const auto channel { static_cast<size_t> (juce::jmax (0, tokens[1].getIntValue())) };
+        if (summary.size() <= channel)
+            summary.resize (channel + 1);
+
+        auto& s { summary[channel] };
+        s.hash = tokens[2];
+        s.rmsDb = tokens[3].getFloatValue();
+        s.peakDb = tokens[4].getFloatValue();
+        for (auto i = 5; i < tokens.size(); ++i)
+            s.envelopeDb.push_back (tokens[i].getFloatValue());
+    }
+
+    return summaries;
+}
+
+juce::String RenderVerifier::compareSummaries (const Summary& render, const Summary& reference)
+{
+    if (render.size() != reference.size())
+        return "render has " + juce::String (static_cast<int> (render.size())) + " channels, reference " + juce::String (static_cast<int> (reference.size()));
+
+    const auto describe = [] (const juce::String& what, float level, float referenceLevel) {
+        return what + " " + juce::String (level, 2) + " dB against " + juce::String (referenceLevel, 2) + " dB";
+    };
+
+    for (size_t channel = 0; channel < render.size(); ++channel)
+    {
+        const auto& r { render[channel] };
+        const auto& ref { reference[channel] };
+        const auto channelName { "channel " + juce::String (static_cast<int> (channel)) };
+
+        if (std::abs (r.rmsDb - ref.rmsDb) > rmsToleranceDb)
+            return describe (channelName + " RMS", r.rmsDb, ref.rmsDb);
+
+        if (std::abs (r.peakDb - ref.peakDb) > peakToleranceDb)
+            return describe (channelName + " peak", r.peakDb, ref.peakDb);
+
+        if (r.envelopeDb.size() != ref.envelopeDb.size())
+            return channelName + " has a different length from the reference";
+
+        for (size_t window = 0; window < r.envelopeDb.size(); ++window)
+            if (ref.envelopeDb[window] > envelopeFloorDb && std::abs (r.envelopeDb[window] - ref.envelopeDb[window]) > envelopeToleranceDb)
+                return describe (channelName + " level at " + juce::String (window * envelopeWindowSeconds, 1) + " s", r.envelopeDb[window], ref.envelopeDb[window]);
+    }
+
+    return {};
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "OfflineRenderer.h"
+
+/**
+ Golden-render check for the render paths. Fixed stimuli (an impulse, a noise burst, a sine sweep and a long
+ train of noise bursts) are rendered through the plain serial path with each of two fixed settings, a small
+ room with a short decay and a large room with the longest decay, and the results are kept as references,
+ one folder per setting. Verifying renders the same stimuli through every path (serial, chunked in parallel,
+ the SIMD batch engine and the multi-send entry point) and checks each one against the references.
+
+ The references are a summary of each render (RMS, peak and a level envelope, plus a hash of the samples) in
+ summaryFileName, which is small enough to commit, and optionally the renders themselves. Every render is
+ checked against the summary in dB, loosely enough for any compiler or architecture; the hash only reports
+ whether a render is bit-identical. If the reference renders are there too, each path is also checked sample
+ by sample, within that path's tolerance.
+
+ Regenerate the references whenever the sound is meant to change.
+ */
+class RenderVerifier
+{
+public:
+    explicit RenderVerifier (const juce::File& referenceDirToUse);
+
+    /// Renders the stimuli through the serial path and stores the results as the references
+    juce::Result writeReferences();
+
+    /// @param report gets a line for each stimulus and path
+    juce::Result verify (juce::String& report);
+
+    static constexpr const char* summaryFileName { "summary.txt" };
+
+private:
+    static constexpr double sampleRate { 48000.0 };
+
+    /// Levels of one channel of a render
+    struct ChannelSummary
+    {
+        /// FNV-1a of the samples' bit patterns, in hex
+        juce::String hash;
+        float rmsDb { 0.0f };
+        float peakDb { 0.0f };
+
+        /// RMS of each envelopeWindowSeconds, floored at minLevelDb
+        std::vector<float> envelopeDb;
+    };
+
+    using Summary = std::vector<ChannelSummary>;
+
+    static constexpr double envelopeWindowSeconds { 0.5 };
+    static constexpr float minLevelDb { -120.0f };
+
+    /// @returns one summary per channel of the file, or none if it can't be read
+    Summary summarise (const juce::File& file);
+
+    /// Writes the summary of every render in dir to summaryFileName there
+    juce::Result writeSummaries (const juce::File& dir);
+
+    /// @returns the summaries in referenceDir's summaryFileName by render name (setting/stimulus), or none if it's missing
+    std::map<juce::String, Summary> readSummaries() const;
+
+    /// @returns what's out of tolerance between a render's summary and its reference, or an empty string if nothing is
+    static juce::String compareSummaries (const Summary& render, const Summary& reference);
+
+    /// Fixed settings for every render, apart from the room size and decay, which each setting picks
+    static RenderSettings getSettings (float roomSize, float decay);
+
+    static juce::StringArray getStimulusNames();
+    static juce::AudioBuffer<float> makeStimulus (const juce::String& name);
+
+    juce::Result writeStimuli (const juce::File& dir) const;
+
+    /// Renders every stimulus in stimulusDir through the named path, into a folder in outputDir for each setting
+    juce::Result renderPath (const juce::String& path, const juce::File& stimulusDir, const juce::File& outputDir) const;
+
+    /// @returns the largest difference between two files' samples, or -1 if they don't match in length or channels
+    float getMaxDifference (const juce::File& file, const juce::File& reference);
+
+    juce::File referenceDir;
+    juce::AudioFormatManager formatManager;
+};
@@ -0,0 +1,343 @@
+#include <numeric>
+
+#include "ReverbAnalysis.h"
+
+#include "../../../Source/ReverbEngines.h"
+
+namespace
+{
+    // Long enough for the longest decay setting to fall past -25dB in every band
+    static constexpr double impulseResponseSeconds { 8.0 };
+    static constexpr double densityWindowSeconds { 0.02 };
+
+    // Echo density above which the response counts as fully mixed
+    static constexpr float mixedDensity { 0.9f };
+
+    static constexpr double timingSeconds { 10.0 };
+
+    using LinearDelay = InterpolatedDelay<signalsmith::delay::InterpolatorLinear>;
+    using NearestDelay = InterpolatedDelay<signalsmith::delay::InterpolatorNearest>;
+}
+
+ReverbAnalysis::ReverbAnalysis (const RenderSettings& settingsToUse)
+    : settings (settingsToUse)
+{
+}
+
+juce::String ReverbAnalysis::run (double sampleRate) const
+{
+    const std::vector<Measurement> measurements {
+        measure<Reverb<8, 6>> ("8 channels, 6 steps (default)", sampleRate),
+        measure<Reverb<4, 6>> ("4 channels, 6 steps", sampleRate),
+        measure<Reverb<16, 6>> ("16 channels, 6 steps", sampleRate),
+        measure<Reverb<8, 4>> ("8 channels, 4 steps", sampleRate),
+        measure<Reverb<8, 8>> ("8 channels, 8 steps", sampleRate),
+        measure<Engines::Render> ("16 channels, 8 steps (render engine)", sampleRate),
+        measure<Reverb<8, 6, NestedAllpassDiffuser<8>>> ("8 channels, nested allpass diffuser", sampleRate),
+        measure<Reverb<8, 6, HalfLengthChannelDiffuser<8, 6, LinearDelay>, LinearDelay>> ("8 channels, 6 steps, linear interpolation", sampleRate),
+        measure<Reverb<8, 6, HalfLengthChannelDiffuser<8, 6, NearestDelay>, NearestDelay>> ("8 channels, 6 steps, no interpolation", sampleRate),
+    };
+
+    juce::String report;
+    for (const auto& m : measurements)
+        report << format (m) << "\n";
+
+    report << measureBatchSpeedup (sampleRate);
+    return report;
+}
+
+juce::String ReverbAnalysis::measureBatchSpeedup (double sampleRate) const
+{
+    const auto rate { static_cast<float> (sampleRate) };
+    const auto numSamples { static_cast<int> (timingSeconds * sampleRate) };
+
+    juce::AudioBuffer<float> noise (interleavedNativeLanes, numSamples);
+    juce::Random random;
+    for (auto lane = 0; lane < interleavedNativeLanes; ++lane)
+        for (auto i = 0; i < numSamples; ++i)
+            noise.setSample (lane, i, random.nextFloat() * 2.0f - 1.0f);
+
+    const auto timeSeconds = [] (auto&& process) {
+        const auto startTicks { juce::Time::getHighResolutionTicks() };
+        process();
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    };
+
+    // One file after another, the way a render without --batch goes
+    auto serial { noise };
+    auto serialSeconds { 0.0 };
+    for (auto lane = 0; lane < interleavedNativeLanes; ++lane)
+    {
+        Reverb<> reverb (35, 3);
+        reverb.configure (rate, 1);
+        applyRenderSettings (reverb, settings);
+        serialSeconds += timeSeconds ([&] { reverb.processBlock (serial.getWritePointer (lane), serial.getWritePointer (lane), numSamples); });
+    }
+
+    // Every file in one pass, in blocks the size --batch uses
+    auto batch { noise };
+    InterleavedReverb<interleavedNativeLanes> interleaved;
+    interleaved.configure (rate, 1);
+    applyRenderSettings (interleaved, settings);
+    const auto batchSeconds { timeSeconds ([&] {
+        for (auto start = 0; start < numSamples; start += settings.blockSize)
+        {
+            std::array<float*, interleavedNativeLanes> lanes;
+            for (auto lane = 0; lane < interleavedNativeLanes; ++lane)
+                lanes[static_cast<size_t> (lane)] = batch.getWritePointer (lane, start);
+
+            interleaved.processBlock (lanes.data(), lanes.data(), juce::jmin (settings.blockSize, numSamples - start));
+        }
+    }) };
+
+    const auto toNsPerSample = [numSamples] (double seconds) { return 1.0e9 * seconds / (static_cast<double> (numSamples) * interleavedNativeLanes); };
+
+    juce::String text;
+    text << "Batch engine, " << interleavedNativeLanes << " files at once (" << interleavedTargetName << " build)\n";
+    text << "  one at a time      " << juce::String (toNsPerSample (serialSeconds), 1) << " ns/sample\n";
+    text << "  interleaved        " << juce::String (toNsPerSample (batchSeconds), 1) << " ns/sample, " << juce::String (serialSeconds / batchSeconds, 2) << " times as fast\n";
+    return text;
+}
+
+template <typename ReverbType>
+ReverbAnalysis::Measurement ReverbAnalysis::measure (const juce::String& name, double sampleRate) const
+{
+    Measurement m;
+    m.name = name;
+
+    ReverbType reverb (35, 3);
+    reverb.configure (static_cast<float> (sampleRate));
+
+    // From the tables the reverb was configured with, before the render settings move its diffusion time on
+    const auto tables { reverb.getTables() };
+    const auto feedbackSamples { std::accumulate (tables->feedbackTaps.begin(), tables->feedbackTaps.end(), 0) };
+    m.memory = reverb.getMemoryUsage (static_cast<float> (sampleRate));
+
+    applyRenderSettings (reverb, settings);
+    reverb.setDry (0.0f);
+
+    // Every delay in the feedback network adds its length in seconds to the modes per Hz
+    m.predictedModalDensity = static_cast<float> (feedbackSamples / sampleRate);
+
+    std::vector<float> impulseResponse (static_cast<size_t> (impulseResponseSeconds * sampleRate));
+    impulseResponse[0] = 1.0f;
+    reverb.processBlock (impulseResponse.data(), impulseResponse.data(), static_cast<int> (impulseResponse.size()));
+
+    // The impulse response's energy is the gain on white noise
+    const auto energy { std::accumulate (impulseResponse.begin(), impulseResponse.end(), 0.0, [] (double sum, float x) { return sum + static_cast<double> (x) * x; }) };
+    m.levelDb = static_cast<float> (10.0 * std::log10 (energy + 1.0e-30));
+
+    const auto windowSamples { static_cast<int> (densityWindowSeconds * sampleRate) };
+    const auto density { getEchoDensity (impulseResponse, windowSamples) };
+
+    for (size_t i = 0; i < densityCheckpointsMs.size(); ++i)
+    {
+        const auto window { static_cast<size_t> (densityCheckpointsMs[i] * 0.001 * sampleRate / windowSamples) };
+        m.echoDensity[i] = window < density.size() ? density[window] : 0.0f;
+    }
+
+    for (size_t i = 0; i < density.size(); ++i)
+    {
+        if (density[i] >= mixedDensity)
+        {
+            m.mixingTimeMs = static_cast<float> (1000.0 * i * windowSamples / sampleRate);
+            break;
+        }
+    }
+
+    for (size_t band = 0; band < octaveBands.size(); ++band)
+        m.rt60[band] = getRt60 (impulseResponse, sampleRate, octaveBands[band]);
+
+    const auto powerSpectrum { getPowerSpectrum (impulseResponse) };
+    m.spectralFlatness = getSpectralFlatness (powerSpectrum, sampleRate);
+
+    // Modes are counted around 500Hz, so use the decay there to size their bandwidth
+    m.measuredModalDensity = getModalDensity (powerSpectrum, sampleRate, m.rt60[2]);
+
+    // Time a fresh reverb on noise, so the numbers aren't flattered by running on silence
+    ReverbType timed (35, 3);
+    timed.configure (static_cast<float> (sampleRate), 1);
+    applyRenderSettings (timed, settings);
+
+    std::vector<float> noise (static_cast<size_t> (timingSeconds * sampleRate));
+    juce::Random random;
+    for (auto& sample : noise)
+        sample = random.nextFloat() * 2.0f - 1.0f;
+
+    const auto startTicks { juce::Time::getHighResolutionTicks() };
+    timed.processBlock (noise.data(), noise.data(), static_cast<int> (noise.size()));
+    const auto seconds { juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks) };
+    m.nsPerSample = 1.0e9 * seconds / static_cast<double> (noise.size());
+
+    return m;
+}
+
+juce::String ReverbAnalysis::formatMemory (const ReverbMemoryUsage& usage)
+{
+    const auto toKb = [] (size_t bytes) { return juce::String (static_cast<double> (bytes) / 1024.0, 1) + " KB"; };
+
+    return toKb (usage.getTotal()) + " (diffuser " + toKb (usage.diffuser) + ", early " + toKb (usage.early) + ", feedback " + toKb (usage.feedback)
+           + ", instance " + toKb (usage.instance) + ", tables " + toKb (usage.tables)
+           + ", kernels " + toKb (usage.kernels) + ")";
+}
+
+juce::String ReverbAnalysis::format (const Measurement& m)
+{
+    juce::String text;
+    text << m.name << "\n";
+    text << "  memory             " << formatMemory (m.memory) << "\n";
+
+    text << "  echo density      ";
+    for (size_t i = 0; i < densityCheckpointsMs.size(); ++i)
+        text << " " << juce::String (m.echoDensity[i], 2) << " @ " << juce::roundToInt (densityCheckpointsMs[i]) << " ms";
+
+    text << ", mixed " << (m.mixingTimeMs < 0.0f ? juce::String ("never") : "after " + juce::String (juce::roundToInt (m.mixingTimeMs)) + " ms") << "\n";
+
+    text << "  RT60              ";
+    for (size_t band = 0; band < octaveBands.size(); ++band)
+    {
+        const auto bandName { octaveBands[band] < 1000.0f ? juce::String (juce::roundToInt (octaveBands[band])) : juce::String (juce::roundToInt (octaveBands[band] / 1000.0f)) + "k" };
+        text << " " << bandName << ": " << (m.rt60[band] < 0.0f ? juce::String ("-") : juce::String (m.rt60[band], 2) + " s");
+    }
+
+    text << "\n";
+    text << "  level              " << juce::String (m.levelDb, 2) << " dB\n";
+    text << "  spectral flatness  " << juce::String (m.spectralFlatness, 3) << "\n";
+    text << "  modal density      " << juce::String (m.predictedModalDensity, 2) << " modes/Hz predicted, " << juce::String (m.measuredModalDensity, 2) << " peaks/Hz measured\n";
+    text << "  cost               " << juce::String (m.nsPerSample, 1) << " ns/sample\n";
+    return text;
+}
+
+std::vector<float> ReverbAnalysis::getEchoDensity (const std::vector<float>& impulseResponse, int windowSamples)
+{
+    // Fraction of a Gaussian's samples more than one standard deviation from the mean, erfc (1 / sqrt (2))
+    static constexpr float gaussianFraction { 0.3173f };
+
+    std::vector<float> density;
+    for (size_t start = 0; start + static_cast<size_t> (windowSamples) <= impulseResponse.size(); start += static_cast<size_t> (windowSamples))
+    {
+        const auto begin { impulseResponse.begin() + static_cast<std::ptrdiff_t> (start) };
+        const auto end { begin + windowSamples };
+
+        const auto mean { std::accumulate (begin, end, 0.0f) / windowSamples };
+        const auto variance { std::accumulate (begin, end, 0.0f, [mean] (float sum, float x) { return sum + (x - mean) * (x - mean); }) / windowSamples };
+        const auto deviation { std::sqrt (variance) };
+
+        const auto outliers { std::count_if (begin, end, [mean, deviation] (float x) { return std::abs (x - mean) > deviation; }) };
+        density.push_back (static_cast<float> (outliers) / windowSamples / gaussianFraction);
+    }
+
+    return density;
+}
+
+float ReverbAnalysis::getRt60 (const std::vector<float>& impulseResponse, double sampleRate, float bandHz)
+{
+    if (bandHz >= sampleRate / 2.0)
+        return -1.0f;
+
+    // Two passes of a band pass an octave wide
+    auto band { impulseResponse };
+    for (auto pass = 0; pass < 2; ++pass)
+    {
+        juce::IIRFilter filter;
+        filter.setCoefficients (juce::IIRCoefficients::makeBandPass (sampleRate, bandHz, juce::MathConstants<double>::sqrt2));
+        filter.processSamples (band.data(), static_cast<int> (band.size()));
+    }
+
+    // Schroeder backward integration gives the energy decay curve
+    std::vector<double> decayCurve (band.size());
+    auto energy { 0.0 };
+    for (auto i = band.size(); i-- > 0;)
+    {
+        energy += static_cast<double> (band[i]) * band[i];
+        decayCurve[i] = energy;
+    }
+
+    if (energy <= 0.0)
+        return -1.0f;
+
+    // Least squares fit of the curve in dB between -5 and -25dB
+    double sumT { 0.0 }, sumDb { 0.0 }, sumTT { 0.0 }, sumTDb { 0.0 };
+    int count { 0 };
+    for (size_t i = 0; i < decayCurve.size(); ++i)
+    {
+        const auto db { 10.0 * std::log10 (decayCurve[i] / energy + 1.0e-30) };
+        if (db > -5.0)
+            continue;
+        if (db < -25.0)
+            break;
+
+        const auto t { static_cast<double> (i) / sampleRate };
+        sumT += t;
+        sumDb += db;
+        sumTT += t * t;
+        sumTDb += t * db;
+        ++count;
+    }
+
+    if (count < 2 || decayCurve.back() / energy > std::pow (10.0, -2.5))
+        return -1.0f;
+
+    const auto slope { (count * sumTDb - sumT * sumDb) / (count * sumTT - sumT * sumT) };
+    return slope < 0.0 ? static_cast<float> (-60.0 / slope) : -1.0f;
+}
+
+std::vector<float> ReverbAnalysis::getPowerSpectrum (const std::vector<float>& impulseResponse)
+{
+    const auto order { juce::roundToInt (std::ceil (std::log2 (static_cast<double> (impulseResponse.size())))) };
+    juce::dsp::FFT fft (order);
+
+    std::vector<float> data (static_cast<size_t> (2 * fft.getSize()), 0.0f);
+    std::copy (impulseResponse.begin(), impulseResponse.end(), data.begin());
+    fft.performFrequencyOnlyForwardTransform (data.data());
+
+    std::vector<float> power (static_cast<size_t> (fft.getSize() / 2 + 1));
+    for (size_t bin = 0; bin < power.size(); ++bin)
+        power[bin] = data[bin] * data[bin];
+
+    return power;
+}
+
+float ReverbAnalysis::getSpectralFlatness (const std::vector<float>& powerSpectrum, double sampleRate)
+{
+    const auto binHz { sampleRate / (2.0 * (powerSpectrum.size() - 1)) };
+    const auto firstBin { static_cast<size_t> (100.0 / binHz) };
+    const auto lastBin { juce::jmin (powerSpectrum.size() - 1, static_cast<size_t> (10000.0 / binHz)) };
+
+    auto logSum { 0.0 };
+    auto sum { 0.0 };
+    for (auto bin = firstBin; bin <= lastBin; ++bin)
+    {
+        logSum += std::log (static_cast<double> (powerSpectrum[bin]) + 1.0e-30);
+        sum += powerSpectrum[bin];
+    }
+
+    const auto numBins { static_cast<double> (lastBin - firstBin + 1) };
+    return sum > 0.0 ? static_cast<float> (std::exp (logSum / numBins) / (sum / numBins)) : 0.0f;
+}
+
+float ReverbAnalysis::getModalDensity (const std::vector<float>& powerSpectrum, double sampleRate, float rt60)
+{
+    static constexpr double lowHz { 200.0 };
+    static constexpr double highHz { 1000.0 };
+
+    const auto binHz { sampleRate / (2.0 * (powerSpectrum.size() - 1)) };
+
+    // A mode decaying by 60dB in rt60 seconds is about 2.2 / rt60 Hz wide
+    const auto bandwidthHz { rt60 > 0.0f ? 2.2 / rt60 : binHz };
+    const auto halfWidthBins { juce::jmax<size_t> (1, static_cast<size_t> (0.5 * bandwidthHz / binHz)) };
+
+    const auto firstBin { static_cast<size_t> (lowHz / binHz) };
+    const auto lastBin { static_cast<size_t> (highHz / binHz) };
+
+    auto peaks { 0 };
+    for (auto bin = firstBin; bin <= lastBin; ++bin)
+    {
+        const auto begin { powerSpectrum.begin() + static_cast<std::ptrdiff_t> (bin - halfWidthBins) };
+        const auto end { powerSpectrum.begin() + static_cast<std::ptrdiff_t> (bin + halfWidthBins + 1) };
+        if (std::max_element (begin, end) == powerSpectrum.begin() + static_cast<std::ptrdiff_t> (bin))
+            ++peaks;
+    }
+
+    return static_cast<float> (peaks / (highHz - lowHz));
+}
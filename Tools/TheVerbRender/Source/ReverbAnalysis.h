@@ -0,0 +1,78 @@
+#pragma once
+
+#include "OfflineRenderer.h"
+
+/**
+ Measures how good each variant of the reverb sounds against what it costs, so channel counts, diffusion
+ steps, diffusers and interpolation can be picked with numbers. Every variant renders an impulse response
+ with the same settings. The analysis reports:
+ - echo density over time, and when the response becomes fully dense
+ - RT60 per octave band
+ - spectral flatness, where lower means more colouration
+ - modal density, both predicted from the feedback delays and counted from the spectrum
+ - level, as the energy of the impulse response, so the engines the plugin switches between can be level-matched
+ - memory by stage and the time per sample to process noise
+
+ It also times the --batch engine against rendering the same files one at a time.
+ */
+class ReverbAnalysis
+{
+public:
+    explicit ReverbAnalysis (const RenderSettings& settingsToUse);
+
+    /// @returns a report with one section per variant
+    juce::String run (double sampleRate) const;
+
+    /// @returns the total in KB, followed by each stage's share
+    static juce::String formatMemory (const ReverbMemoryUsage& usage);
+
+private:
+    static constexpr std::array<float, 7> octaveBands { 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f };
+    static constexpr std::array<float, 4> densityCheckpointsMs { 50.0f, 100.0f, 200.0f, 400.0f };
+
+    struct Measurement
+    {
+        juce::String name;
+        ReverbMemoryUsage memory;
+        std::array<float, densityCheckpointsMs.size()> echoDensity {};
+        float mixingTimeMs { -1.0f };
+        std::array<float, octaveBands.size()> rt60 {};
+        float spectralFlatness { 0.0f };
+        float predictedModalDensity { 0.0f };
+        float measuredModalDensity { 0.0f };
+        float levelDb { 0.0f };
+        double nsPerSample { 0.0 };
+    };
+
+    template <typename ReverbType>
+    Measurement measure (const juce::String& name, double sampleRate) const;
+
+    static juce::String format (const Measurement& m);
+
+    /// @returns the time per sample per file of Reverb<> and of InterleavedReverb on a full set of lanes
+    juce::String measureBatchSpeedup (double sampleRate) const;
+
+    /**
+     @returns the normalised echo density (Abel & Huang) of each window of the impulse response: the fraction
+     of samples more than one standard deviation from the window's mean, relative to Gaussian noise. Dense
+     reverb reads about 1, sparse echoes much less.
+     */
+    static std::vector<float> getEchoDensity (const std::vector<float>& impulseResponse, int windowSamples);
+
+    /// @returns the RT60 in the octave around bandHz, from the slope of the Schroeder decay curve between -5 and -25dB, or -1 if it doesn't decay that far
+    static float getRt60 (const std::vector<float>& impulseResponse, double sampleRate, float bandHz);
+
+    /// @returns the power spectrum of the impulse response, from 0 to half the sample rate
+    static std::vector<float> getPowerSpectrum (const std::vector<float>& impulseResponse);
+
+    /// @returns the ratio of geometric to arithmetic mean power between 100Hz and 10kHz
+    static float getSpectralFlatness (const std::vector<float>& powerSpectrum, double sampleRate);
+
+    /**
+     @returns spectral peaks per Hz between 200Hz and 1kHz. A peak has to be the highest within a mode's
+     bandwidth either side, which is set by the decay time.
+     */
+    static float getModalDensity (const std::vector<float>& powerSpectrum, double sampleRate, float rt60);
+
+    RenderSettings settings;
+};
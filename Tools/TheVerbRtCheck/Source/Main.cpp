@@ -0,0 +1,139 @@
+#include "RtGuard.h"
+#include "../../../Source/PluginProcessor.h"
+
+namespace
+{
+    constexpr double sampleRates[] { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+    constexpr int maxBlockSizeLimit { 4096 };
+
+    /// Where the fuzzer was when it called processBlock, to report with the first violation
+    struct BlockContext
+    {
+        int round { 0 };
+        int block { 0 };
+        double sampleRate { 0.0 };
+        int maxBlockSize { 0 };
+        int numSamples { 0 };
+        bool nonRealtime { false };
+        size_t memoryBudget { 0 };
+
+        juce::String toString() const
+        {
+            return "round " + juce::String (round) + ", block " + juce::String (block) + ": " + juce::String (numSamples) + " samples at "
+                 + juce::String (sampleRate) + " Hz, prepared for " + juce::String (maxBlockSize) + ", "
+                 + (nonRealtime ? "non-realtime" : "realtime") + ", memory budget "
+                 + (memoryBudget == 0 ? juce::String ("unlimited") : juce::String (memoryBudget / 1024) + " KB");
+        }
+    };
+
+    /// No limit, just enough for the live engine alone, or too little for anything, so every engine plan is exercised
+    size_t pickMemoryBudget (juce::Random& random, double sampleRate)
+    {
+        switch (random.nextInt (3))
+        {
+            case 0: return 0;
+            case 1: return Engines::getStereoUsage<Engines::Live> (static_cast<float> (sampleRate)).getTotal();
+            default: return 1;
+        }
+    }
+
+    void automate (juce::Random& random, TheVerbAudioProcessor& processor)
+    {
+        for (auto* param : processor.getParameters())
+            if (random.nextInt (4) == 0)
+                param->setValueNotifyingHost (random.nextFloat());
+    }
+
+    void check (const juce::ArgumentList& args)
+    {
+        const auto seed { args.containsOption ("--seed") ? args.getValueForOption ("--seed").getLargeIntValue() : juce::Time::currentTimeMillis() };
+        const auto numRounds { args.containsOption ("--rounds") ? args.getValueForOption ("--rounds").getIntValue() : 100 };
+
+        std::cout << "Checking " << (PERF_INSTRUMENTATION ? "an instrumented" : "the shipping") << " processBlock with seed " << seed << "\n";
+        RtGuard::install();
+
+        juce::Random random (seed);
+        TheVerbAudioProcessor processor;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+        juce::String firstViolation;
+
+        for (auto round = 0; round < numRounds; ++round)
+        {
+            BlockContext context;
+            context.round = round;
+            context.sampleRate = sampleRates[random.nextInt (static_cast<int> (std::size (sampleRates)))];
+            context.maxBlockSize = 1 + random.nextInt (maxBlockSizeLimit);
+            context.nonRealtime = random.nextBool();
+            context.memoryBudget = pickMemoryBudget (random, context.sampleRate);
+
+            // Everything a host does before playback is allowed to allocate
+            processor.setMemoryBudget (context.memoryBudget);
+            processor.setNonRealtime (context.nonRealtime);
+            processor.setRateAndBufferSizeDetails (context.sampleRate, context.maxBlockSize);
+            processor.prepareToPlay (context.sampleRate, context.maxBlockSize);
+            buffer.setSize (processor.getTotalNumOutputChannels(), context.maxBlockSize);
+
+            // Up to six seconds of audio per round
+            const auto numBlocks { 16 + random.nextInt (static_cast<int> (6.0 * context.sampleRate) / context.maxBlockSize + 1) };
+            for (auto block = 0; block < numBlocks; ++block)
+            {
+                automate (random, processor);
+
+                // Hosts flip into and out of bouncing without preparing again
+                if (random.nextInt (64) == 0)
+                {
+                    context.nonRealtime = ! context.nonRealtime;
+                    processor.setNonRealtime (context.nonRealtime);
+                }
+
+                context.block = block;
+                context.numSamples = random.nextInt (context.maxBlockSize + 1);
+
+                for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+                    for (auto i = 0; i < context.numSamples; ++i)
+                        buffer.setSample (channel, i, random.nextFloat() * 2.0f - 1.0f);
+
+                juce::AudioBuffer<float> view (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), context.numSamples);
+
+                const auto violationsBefore { RtGuard::getNumViolations() };
+                {
+                    const RtGuard::Scope guard;
+                    processor.processBlock (view, midi);
+                }
+
+                if (firstViolation.isEmpty() && RtGuard::getNumViolations() > violationsBefore)
+                    firstViolation = juce::String (RtGuard::getName (RtGuard::getFirstViolation())) + " in " + context.toString();
+            }
+
+            processor.releaseResources();
+        }
+
+        const auto numViolations { RtGuard::getNumViolations() };
+        if (numViolations > 0)
+            juce::ConsoleApplication::fail (juce::String (numViolations) + " calls in processBlock weren't real-time safe, the first a "
+                                            + firstViolation + ". Rerun with --seed " + juce::String (seed)
+                                            + " and break on RtGuard::onViolation to see where.");
+
+        std::cout << "No allocations, locks, waits or blocking calls in " << numRounds << " rounds\n";
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "TheVerbRtCheck: checks TheVerb's processBlock is real-time safe", true);
+    app.addDefaultCommand ({ "",
+        "[--seed <n>] [--rounds <n>]",
+        "Fuzzes processBlock, failing on any allocation, lock, wait or blocking system call inside it",
+        "Each round prepares the processor at a random sample rate, block size, memory budget and realtime or\n"
+        "non-realtime mode, then calls processBlock with blocks of random length up to the prepared size, automating\n"
+        "random parameters and switching between realtime and non-realtime in between. Everything is caught on Linux;\n"
+        "elsewhere only allocations through operator new are. --seed defaults to the time; it's printed so a failure\n"
+        "can be repeated.",
+        check });
+
+    return app.findAndRunCommand (argc, argv);
+}
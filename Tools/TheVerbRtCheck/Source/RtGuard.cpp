@@ -0,0 +1,490 @@
+#include "RtGuard.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX
+    #include <dlfcn.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <semaphore.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+namespace RtGuard
+{
+    namespace
+    {
+        // Plain and zero-initialised, so using them never allocates, even on a thread's first call
+        thread_local bool guarded { false };
+        std::atomic<int> numViolations { 0 };
+        std::atomic<int> firstViolation { -1 };
+
+        inline void check (Violation violation)
+        {
+            if (! guarded)
+                return;
+
+            // Off while reporting, so anything onViolation reaches isn't counted again
+            guarded = false;
+            onViolation (violation);
+            guarded = true;
+        }
+    }
+
+    const char* getName (Violation violation)
+    {
+        switch (violation)
+        {
+            case Violation::allocation:
+                return "heap allocation";
+            case Violation::free:
+                return "heap free";
+            case Violation::lock:
+                return "mutex lock";
+            case Violation::wait:
+                return "wait on a condition or semaphore";
+            case Violation::systemCall:
+                return "blocking system call";
+        }
+
+        return "unknown";
+    }
+
+    Scope::Scope() { guarded = true; }
+
+    Scope::~Scope() { guarded = false; }
+
+    int getNumViolations() { return numViolations.load(); }
+
+    Violation getFirstViolation() { return static_cast<Violation> (firstViolation.load()); }
+
+    void reset()
+    {
+        numViolations = 0;
+        firstViolation = -1;
+    }
+
+    __attribute__ ((noinline)) void onViolation (Violation violation)
+    {
+        auto expected { -1 };
+        firstViolation.compare_exchange_strong (expected, static_cast<int> (violation));
+        ++numViolations;
+    }
+}
+
+#if JUCE_LINUX
+// glibc's own allocator, which the allocation hooks forward to
+extern "C" void* __libc_malloc (size_t);
+extern "C" void* __libc_calloc (size_t, size_t);
+extern "C" void* __libc_realloc (void*, size_t);
+extern "C" void* __libc_memalign (size_t, size_t);
+extern "C" void __libc_free (void*);
+
+namespace
+{
+    /**
+     The definition of a libc function that ours hides, looked up on first use. Constant-initialised, so
+     it's usable from hooks that run before main.
+     */
+    template <typename Fn>
+    struct RealFunction
+    {
+        const char* name;
+
+        /// Symbol version to ask for, where dlsym's unversioned lookup would find an old ABI
+        const char* version;
+
+        std::atomic<Fn> fn { nullptr };
+
+        Fn get()
+        {
+            auto resolved { fn.load (std::memory_order_acquire) };
+            if (resolved == nullptr)
+            {
+                if (version != nullptr)
+                    resolved = reinterpret_cast<Fn> (dlvsym (RTLD_NEXT, name, version));
+
+                if (resolved == nullptr)
+                    resolved = reinterpret_cast<Fn> (dlsym (RTLD_NEXT, name));
+
+                fn.store (resolved, std::memory_order_release);
+            }
+
+            return resolved;
+        }
+    };
+
+    RealFunction<int (*) (pthread_mutex_t*)> realMutexLock { "pthread_mutex_lock", nullptr };
+    RealFunction<int (*) (pthread_mutex_t*)> realMutexTryLock { "pthread_mutex_trylock", nullptr };
+    RealFunction<int (*) (pthread_cond_t*, pthread_mutex_t*)> realCondWait { "pthread_cond_wait", "GLIBC_2.3.2" };
+    RealFunction<int (*) (pthread_cond_t*, pthread_mutex_t*, const timespec*)> realCondTimedWait { "pthread_cond_timedwait", "GLIBC_2.3.2" };
+#if __GLIBC_PREREQ(2, 30)
+    RealFunction<int (*) (pthread_cond_t*, pthread_mutex_t*, clockid_t, const timespec*)> realCondClockWait { "pthread_cond_clockwait", nullptr };
+#endif
+    RealFunction<int (*) (sem_t*)> realSemWait { "sem_wait", nullptr };
+    RealFunction<int (*) (sem_t*, const timespec*)> realSemTimedWait { "sem_timedwait", nullptr };
+
+    RealFunction<int (*) (const char*, int, ...)> realOpen { "open", nullptr };
+    RealFunction<int (*) (int, const char*, int, ...)> realOpenAt { "openat", nullptr };
+    RealFunction<int (*) (int)> realClose { "close", nullptr };
+    RealFunction<ssize_t (*) (int, void*, size_t)> realRead { "read", nullptr };
+    RealFunction<ssize_t (*) (int, const void*, size_t)> realWrite { "write", nullptr };
+    RealFunction<ssize_t (*) (int, void*, size_t, off_t)> realPRead { "pread", nullptr };
+    RealFunction<ssize_t (*) (int, const void*, size_t, off_t)> realPWrite { "pwrite", nullptr };
+    RealFunction<int (*) (int)> realFsync { "fsync", nullptr };
+    RealFunction<FILE* (*) (const char*, const char*)> realFOpen { "fopen", nullptr };
+    RealFunction<size_t (*) (void*, size_t, size_t, FILE*)> realFRead { "fread", nullptr };
+    RealFunction<size_t (*) (const void*, size_t, size_t, FILE*)> realFWrite { "fwrite", nullptr };
+    RealFunction<int (*) (FILE*)> realFFlush { "fflush", nullptr };
+#if ! defined(__USE_FILE_OFFSET64)
+    RealFunction<int (*) (const char*, int, ...)> realOpen64 { "open64", nullptr };
+    RealFunction<int (*) (int, const char*, int, ...)> realOpenAt64 { "openat64", nullptr };
+    RealFunction<ssize_t (*) (int, void*, size_t, off64_t)> realPRead64 { "pread64", nullptr };
+    RealFunction<ssize_t (*) (int, const void*, size_t, off64_t)> realPWrite64 { "pwrite64", nullptr };
+    RealFunction<FILE* (*) (const char*, const char*)> realFOpen64 { "fopen64", nullptr };
+#endif
+    RealFunction<int (*) (useconds_t)> realUSleep { "usleep", nullptr };
+    RealFunction<int (*) (const timespec*, timespec*)> realNanoSleep { "nanosleep", nullptr };
+
+    /// open and openat only take a mode when they might create the file
+    mode_t getMode (int flags, va_list args)
+    {
+        return (flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE ? static_cast<mode_t> (va_arg (args, int)) : 0;
+    }
+}
+
+void RtGuard::install()
+{
+    realMutexLock.get();
+    realMutexTryLock.get();
+    realCondWait.get();
+    realCondTimedWait.get();
+#if __GLIBC_PREREQ(2, 30)
+    realCondClockWait.get();
+#endif
+    realSemWait.get();
+    realSemTimedWait.get();
+    realOpen.get();
+    realOpenAt.get();
+    realClose.get();
+    realRead.get();
+    realWrite.get();
+    realPRead.get();
+    realPWrite.get();
+    realFsync.get();
+    realFOpen.get();
+    realFRead.get();
+    realFWrite.get();
+    realFFlush.get();
+#if ! defined(__USE_FILE_OFFSET64)
+    realOpen64.get();
+    realOpenAt64.get();
+    realPRead64.get();
+    realPWrite64.get();
+    realFOpen64.get();
+#endif
+    realUSleep.get();
+    realNanoSleep.get();
+}
+
+extern "C"
+{
+    void* malloc (size_t size) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t numElements, size_t elementSize) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        return __libc_calloc (numElements, elementSize);
+    }
+
+    void* realloc (void* ptr, size_t size) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        return __libc_realloc (ptr, size);
+    }
+
+    void* memalign (size_t alignment, size_t size) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        return __libc_memalign (alignment, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** result, size_t alignment, size_t size) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::allocation);
+        *result = __libc_memalign (alignment, size);
+        return *result != nullptr ? 0 : ENOMEM;
+    }
+
+    void free (void* ptr) noexcept
+    {
+        if (ptr != nullptr)
+            RtGuard::check (RtGuard::Violation::free);
+
+        __libc_free (ptr);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::lock);
+        return realMutexLock.get() (mutex);
+    }
+
+    // Even a lock that's free is a kernel call away from blocking if it isn't, so trylock counts too
+    int pthread_mutex_trylock (pthread_mutex_t* mutex) noexcept
+    {
+        RtGuard::check (RtGuard::Violation::lock);
+        return realMutexTryLock.get() (mutex);
+    }
+
+    int pthread_cond_wait (pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        RtGuard::check (RtGuard::Violation::wait);
+        return realCondWait.get() (condition, mutex);
+    }
+
+    int pthread_cond_timedwait (pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* timeout)
+    {
+        RtGuard::check (RtGuard::Violation::wait);
+        return realCondTimedWait.get() (condition, mutex, timeout);
+    }
+
+#if __GLIBC_PREREQ(2, 30)
+    // What std::condition_variable's timed waits call
+    int pthread_cond_clockwait (pthread_cond_t* condition, pthread_mutex_t* mutex, clockid_t clock, const timespec* timeout)
+    {
+        RtGuard::check (RtGuard::Violation::wait);
+        return realCondClockWait.get() (condition, mutex, clock, timeout);
+    }
+#endif
+
+    int sem_wait (sem_t* semaphore)
+    {
+        RtGuard::check (RtGuard::Violation::wait);
+        return realSemWait.get() (semaphore);
+    }
+
+    int sem_timedwait (sem_t* semaphore, const timespec* timeout)
+    {
+        RtGuard::check (RtGuard::Violation::wait);
+        return realSemTimedWait.get() (semaphore, timeout);
+    }
+
+    int open (const char* path, int flags, ...)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        va_list args;
+        va_start (args, flags);
+        const auto mode { getMode (flags, args) };
+        va_end (args);
+        return realOpen.get() (path, flags, mode);
+    }
+
+    int openat (int dirFd, const char* path, int flags, ...)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        va_list args;
+        va_start (args, flags);
+        const auto mode { getMode (flags, args) };
+        va_end (args);
+        return realOpenAt.get() (dirFd, path, flags, mode);
+    }
+
+    int close (int fd)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realClose.get() (fd);
+    }
+
+    ssize_t read (int fd, void* buffer, size_t numBytes)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realRead.get() (fd, buffer, numBytes);
+    }
+
+    ssize_t write (int fd, const void* buffer, size_t numBytes)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realWrite.get() (fd, buffer, numBytes);
+    }
+
+    ssize_t pread (int fd, void* buffer, size_t numBytes, off_t offset)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realPRead.get() (fd, buffer, numBytes, offset);
+    }
+
+    ssize_t pwrite (int fd, const void* buffer, size_t numBytes, off_t offset)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realPWrite.get() (fd, buffer, numBytes, offset);
+    }
+
+    int fsync (int fd)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFsync.get() (fd);
+    }
+
+    // stdio reaches the kernel through libc's internal calls, which don't go through the hooks above
+    FILE* fopen (const char* path, const char* mode)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFOpen.get() (path, mode);
+    }
+
+    size_t fread (void* buffer, size_t size, size_t count, FILE* stream)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFRead.get() (buffer, size, count, stream);
+    }
+
+    size_t fwrite (const void* buffer, size_t size, size_t count, FILE* stream)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFWrite.get() (buffer, size, count, stream);
+    }
+
+    int fflush (FILE* stream)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFFlush.get() (stream);
+    }
+
+#if ! defined(__USE_FILE_OFFSET64)
+    // What callers built with _FILE_OFFSET_BITS=64, like JUCE, actually call
+    int open64 (const char* path, int flags, ...)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        va_list args;
+        va_start (args, flags);
+        const auto mode { getMode (flags, args) };
+        va_end (args);
+        return realOpen64.get() (path, flags, mode);
+    }
+
+    int openat64 (int dirFd, const char* path, int flags, ...)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        va_list args;
+        va_start (args, flags);
+        const auto mode { getMode (flags, args) };
+        va_end (args);
+        return realOpenAt64.get() (dirFd, path, flags, mode);
+    }
+
+    ssize_t pread64 (int fd, void* buffer, size_t numBytes, off64_t offset)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realPRead64.get() (fd, buffer, numBytes, offset);
+    }
+
+    ssize_t pwrite64 (int fd, const void* buffer, size_t numBytes, off64_t offset)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realPWrite64.get() (fd, buffer, numBytes, offset);
+    }
+
+    FILE* fopen64 (const char* path, const char* mode)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realFOpen64.get() (path, mode);
+    }
+#endif
+
+    int usleep (useconds_t microseconds)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realUSleep.get() (microseconds);
+    }
+
+    int nanosleep (const timespec* duration, timespec* remaining)
+    {
+        RtGuard::check (RtGuard::Violation::systemCall);
+        return realNanoSleep.get() (duration, remaining);
+    }
+}
+#else
+void RtGuard::install()
+{
+}
+
+// Without the C hooks, catch what goes through operator new and delete at least
+void* operator new (size_t size)
+{
+    RtGuard::check (RtGuard::Violation::allocation);
+    if (auto* ptr = std::malloc (size == 0 ? 1 : size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size)
+{
+    return operator new (size);
+}
+
+void* operator new (size_t size, const std::nothrow_t&) noexcept
+{
+    RtGuard::check (RtGuard::Violation::allocation);
+    return std::malloc (size == 0 ? 1 : size);
+}
+
+void* operator new[] (size_t size, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new (size, nothrow);
+}
+
+void* operator new (size_t size, std::align_val_t alignment)
+{
+    RtGuard::check (RtGuard::Violation::allocation);
+    void* ptr { nullptr };
+    if (posix_memalign (&ptr, juce::jmax (sizeof (void*), static_cast<size_t> (alignment)), size == 0 ? 1 : size) == 0)
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (size_t size, std::align_val_t alignment)
+{
+    return operator new (size, alignment);
+}
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        RtGuard::check (RtGuard::Violation::free);
+
+    std::free (ptr);
+}
+
+void operator delete[] (void* ptr) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr, size_t) noexcept { operator delete (ptr); }
+
+void operator delete[] (void* ptr, size_t) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr, std::align_val_t) noexcept { operator delete (ptr); }
+
+void operator delete[] (void* ptr, std::align_val_t) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr, size_t, std::align_val_t) noexcept { operator delete (ptr); }
+
+void operator delete[] (void* ptr, size_t, std::align_val_t) noexcept { operator delete (ptr); }
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "juce_core/juce_core.h"
+
+/**
+ Catches calls that aren't real-time safe on the thread inside a Scope: heap allocation and frees, taking or
+ waiting on a lock, and blocking system calls (file and console I/O, sleeping). Nothing is caught outside a
+ Scope, so prepareToPlay and the like can allocate as usual.
+
+ On Linux the C allocator, the pthread mutex, condition variable and semaphore calls, and the I/O and sleep
+ calls are replaced for the whole process, which covers operator new, JUCE's HeapBlock, std::mutex,
+ CriticalSection, WaitableEvent, files and streams. Elsewhere only the global operator new and delete are
+ replaced, so run the check on Linux for full coverage.
+ */
+namespace RtGuard
+{
+    enum class Violation
+    {
+        allocation,
+        free,
+        lock,
+        wait,
+        systemCall
+    };
+
+    const char* getName (Violation violation);
+
+    /// Call before the first Scope, from one thread, to resolve the real functions the hooks forward to
+    void install();
+
+    /// Guards the calling thread for its lifetime
+    class Scope
+    {
+    public:
+        Scope();
+        ~Scope();
+
+        JUCE_DECLARE_NON_COPYABLE (Scope)
+    };
+
+    /// How many violations there have been since the last reset, on any thread
+    int getNumViolations();
+
+    /// The kind of the first violation since the last reset. Only meaningful if getNumViolations() > 0.
+    Violation getFirstViolation();
+
+    void reset();
+
+    /**
+     Called for every violation, with the guard off. Break here in a debugger to see where in processBlock it
+     came from.
+     */
+    void onViolation (Violation violation);
+}